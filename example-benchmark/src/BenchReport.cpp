@@ -0,0 +1,143 @@
+#include "BenchReport.h"
+
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#include "ofMain.h"
+
+//--------------------------------------------------------------
+// Every allocation in the app goes through here. Counted per thread so a
+// workload sees its own, not the receive threads' or the mock server's.
+
+static thread_local uint64_t threadAllocations = 0;
+static thread_local uint64_t threadAllocatedBytes = 0;
+
+void *operator new(std::size_t size)
+{
+    threadAllocations++;
+    threadAllocatedBytes += size;
+    if(void *p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+// the ring buffer slots are cache line aligned and come through here
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    threadAllocations++;
+    threadAllocatedBytes += size;
+    std::size_t align = std::max(static_cast<std::size_t>(alignment), sizeof(void*));
+    void *p = nullptr;
+#if defined(_WIN32)
+    p = _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+    if(posix_memalign(&p, align, size == 0 ? 1 : size) != 0) p = nullptr;
+#endif
+    if(p) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(p, alignment);
+}
+
+uint64_t benchThreadAllocations()
+{
+    return threadAllocations;
+}
+
+uint64_t benchThreadAllocatedBytes()
+{
+    return threadAllocatedBytes;
+}
+
+//--------------------------------------------------------------
+void BenchResult::addRoundTrip(double seconds)
+{
+    if(seconds < 0) timeouts++;
+    else latencies.push_back(seconds);
+}
+
+//--------------------------------------------------------------
+double BenchResult::getLatencyPercentile(double p) const
+{
+    if(latencies.empty()) return 0;
+    std::vector<double> sorted = latencies;
+    // nearest rank
+    size_t rank = (size_t)std::ceil(p * sorted.size());
+    size_t index = std::min(std::max<size_t>(rank, 1), sorted.size()) - 1;
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+//--------------------------------------------------------------
+std::string BenchResult::toJson() const
+{
+    double perMessage = messages > 0 ? 1.0 / messages : 0;
+    std::ostringstream json;
+    json << "{\"bench\":\"" << name << "\""
+         << ",\"transport\":\"" << transport << "\""
+         << ",\"messages\":" << messages
+         << ",\"bytes\":" << bytes
+         << ",\"seconds\":" << seconds
+         << ",\"msgsPerSec\":" << (seconds > 0 ? messages / seconds : 0)
+         << ",\"bytesPerSec\":" << (seconds > 0 ? bytes / seconds : 0)
+         << ",\"roundTrips\":" << latencies.size()
+         << ",\"timeouts\":" << timeouts
+         << ",\"latencyP50Us\":" << getLatencyPercentile(0.5) * 1e6
+         << ",\"latencyP99Us\":" << getLatencyPercentile(0.99) * 1e6
+         << ",\"latencyP999Us\":" << getLatencyPercentile(0.999) * 1e6
+         << ",\"allocsPerMsg\":" << allocations * perMessage
+         << "}";
+    return json.str();
+}
+
+//--------------------------------------------------------------
+void writeBenchResults(const std::string &path, const std::vector<BenchResult> &results)
+{
+    std::ofstream file(path);
+    for(auto &r : results){
+        ofLogNotice(r.name) << r.transport << ": "
+            << (r.seconds > 0 ? r.messages / r.seconds : 0) << " msgs/s, "
+            << (r.seconds > 0 ? r.bytes / r.seconds / 1e6 : 0) << " MB/s, round trip p50 "
+            << r.getLatencyPercentile(0.5) * 1e6 << " us, p99 "
+            << r.getLatencyPercentile(0.99) * 1e6 << " us, p999 "
+            << r.getLatencyPercentile(0.999) * 1e6 << " us, "
+            << (r.messages > 0 ? double(r.allocations) / r.messages : 0) << " allocs/msg"
+            << (r.timeouts > 0 ? ", " + ofToString(r.timeouts) + " timeouts" : "");
+        file << r.toJson() << "\n";
+    }
+    if(!file){
+        ofLogError("writeBenchResults") << "couldn't write " << path;
+        return;
+    }
+    ofLogNotice("writeBenchResults") << "results written to " << path;
+}
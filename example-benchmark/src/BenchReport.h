@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*------------------------------------------------------------------------------
+ * Measurements shared by the benchmarks: an allocation counter (operator new
+ * is replaced for the whole app) and results that are written as JSON lines,
+ * one object per run, so they can be compared between commits.
+ *------------------------------------------------------------------------------*/
+
+/// \return allocations made through operator new on the calling thread so far
+uint64_t benchThreadAllocations();
+/// \return bytes asked for by those allocations
+uint64_t benchThreadAllocatedBytes();
+
+struct BenchResult
+{
+    std::string name;
+    std::string transport;
+    uint64_t messages = 0;          ///< messages sent by the workload
+    uint64_t bytes = 0;             ///< bytes the transport sent, framing included
+    double seconds = 0;
+    uint64_t allocations = 0;       ///< on the thread that ran the workload
+    std::vector<double> latencies;  ///< round trips in seconds
+    uint64_t timeouts = 0;          ///< round trips that never came back
+    
+    /// add a round trip, a negative time counts as a timeout
+    void addRoundTrip(double seconds);
+    /// \return the p quantile (0 to 1) of the round trips in seconds, 0 if there are none
+    double getLatencyPercentile(double p) const;
+    std::string toJson() const;
+};
+
+/// log a summary of every result and write them to path, one JSON object per line
+void writeBenchResults(const std::string &path, const std::vector<BenchResult> &results);
@@ -0,0 +1,11 @@
+#include "ofMain.h"
+#include "ofApp.h"
+#include "ofAppNoWindow.h"
+
+//========================================================================
+int main( ){
+	// benchmarks don't draw anything, run headless so they work over ssh too
+	auto window = std::make_shared<ofAppNoWindow>();
+	ofRunApp(window, std::make_shared<ofApp>());
+	return ofRunMainLoop();
+}
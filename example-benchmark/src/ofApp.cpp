@@ -0,0 +1,1091 @@
+#include "ofApp.h"
+#include "BenchReport.h"
+
+#include <random>
+#include <cstring>
+#include <algorithm>
+
+#ifdef OFXSC_HAS_NATIVE_SOCKETS
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#endif
+
+//--------------------------------------------------------------
+// exposes the inbound dispatch so replies can be injected without a socket
+class BenchServer : public ofxSCServer
+{
+public:
+    using ofxSCServer::ofxSCServer;
+    using ofxSCServer::dispatchReply;
+};
+
+//--------------------------------------------------------------
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//--------------------------------------------------------------
+
+void ofApp::setup()
+{
+    benchNodeDispatch();
+    benchReceiveQueue();
+    benchEncode();
+    benchBatchedTransmit();
+    benchReplyStorm();
+    benchBulkTransfer();
+    benchLoopback();
+    benchControlPath();
+    benchTimetagJitter();
+    benchRealtimeSend();
+    benchMultiProducer();
+    benchResourceAllocator();
+    benchServerConstruction();
+    
+    ofExit();
+}
+
+//--------------------------------------------------------------
+// Cost of routing one node notification as the number of live nodes grows.
+// It should stay flat, every reply goes straight to its node.
+//--------------------------------------------------------------
+
+void ofApp::benchNodeDispatch()
+{
+    const int numReplies = 200000;
+    
+    for(int numNodes : {10, 100, 1000, 5000, 20000})
+    {
+        BenchServer server("localhost", 57110, 57131);
+        
+        std::vector<std::unique_ptr<ofxSCSynth>> synths;
+        for(int i = 0; i < numNodes; i++){
+            synths.emplace_back(new ofxSCSynth("sine", &server));
+            synths.back()->create();
+        }
+        
+        // /n_info is ignored by the node, so this measures routing only
+        std::vector<ofxOscMessage> replies(256);
+        for(auto &m : replies){
+            m.setAddress("/n_info");
+            m.addIntArg(synths[ofRandom(numNodes)]->nodeID);
+            m.addIntArg(1);
+            m.addIntArg(-1);
+            m.addIntArg(-1);
+            m.addIntArg(0);
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < numReplies; i++){
+            server.dispatchReply(replies[i & 255]);
+        }
+        double elapsed = secondsSince(start);
+        
+        ofLogNotice("benchNodeDispatch") << numNodes << " nodes: "
+            << elapsed * 1e9 / numReplies << " ns/reply";
+    }
+}
+
+//--------------------------------------------------------------
+// Receive queue: a producer thread pushes /tr messages the way the listener
+// thread does, the app thread collects them. ofThreadChannel (what
+// ofxOscSenderReceiver used before) against ofxSCRingBuffer.
+//--------------------------------------------------------------
+
+void ofApp::benchReceiveQueue()
+{
+    const int numMessages = 1000000;
+    
+    ofxOscMessage tr;
+    tr.setAddress("/tr");
+    tr.addIntArg(1000);
+    tr.addIntArg(0);
+    tr.addFloatArg(0.5);
+    
+    {
+        ofThreadChannel<ofxOscMessage> channel;
+        auto start = std::chrono::steady_clock::now();
+        std::thread producer([&]{
+            for(int i = 0; i < numMessages; i++){
+                ofxOscMessage m = tr;
+                channel.send(std::move(m));
+            }
+        });
+        int received = 0;
+        ofxOscMessage m;
+        while(received < numMessages){
+            if(channel.tryReceive(m)) received++;
+        }
+        producer.join();
+        double elapsed = secondsSince(start);
+        ofLogNotice("benchReceiveQueue") << "ofThreadChannel: " << elapsed * 1e9 / numMessages << " ns/msg";
+    }
+    
+    {
+        ofxSCRingBuffer<ofxOscMessage> ring(8192);
+        auto start = std::chrono::steady_clock::now();
+        std::thread producer([&]{
+            for(int i = 0; i < numMessages; i++){
+                ofxOscMessage m = tr;
+                while(!ring.push(m)) std::this_thread::yield();
+            }
+        });
+        int received = 0;
+        while(received < numMessages){
+            received += ring.drain([](ofxOscMessage &m){});
+        }
+        producer.join();
+        double elapsed = secondsSince(start);
+        ofLogNotice("benchReceiveQueue") << "ofxSCRingBuffer: " << elapsed * 1e9 / numMessages << " ns/msg";
+    }
+}
+
+//--------------------------------------------------------------
+// Encoding and sending a typical /n_set and a 200 message bundle.
+// Nothing listens on the destination port, the datagrams are just dropped.
+//--------------------------------------------------------------
+
+void ofApp::benchEncode()
+{
+    const int numSends = 200000;
+    
+    ofxOscSenderReceiver osc;
+    osc.setup("localhost", 57199, 57132);
+    
+    ofxOscMessage set;
+    set.setAddress("/n_set");
+    set.addIntArg(1000);
+    set.addStringArg("freq");
+    set.addFloatArg(440);
+    
+    ofxOscBundle bundle;
+    for(int i = 0; i < 200; i++) bundle.addMessage(set);
+    
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < numSends; i++){
+        osc.sendMessage(set, true);
+    }
+    double elapsed = secondsSince(start);
+    ofLogNotice("benchEncode") << "/n_set (" << ofxOscSenderReceiver::getEncodedSize(set) << " bytes): "
+        << elapsed * 1e9 / numSends << " ns/send";
+    
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < numSends / 200; i++){
+        osc.sendBundle(bundle);
+    }
+    elapsed = secondsSince(start);
+    ofLogNotice("benchEncode") << "200 message bundle (" << ofxOscSenderReceiver::getEncodedSize(bundle) << " bytes): "
+        << elapsed * 1e9 / (numSends / 200) << " ns/send";
+}
+
+//--------------------------------------------------------------
+// Datagrams sent one syscall each versus queued in batches (sendmmsg on Linux),
+// over loopback to a second socket that counts what arrives.
+//--------------------------------------------------------------
+
+void ofApp::benchBatchedTransmit()
+{
+    const int numDatagrams = 100000;
+    const int batchSize = 64;
+    
+    ofxOscMessage set;
+    set.setAddress("/n_set");
+    set.addIntArg(1000);
+    set.addStringArg("freq");
+    set.addFloatArg(440);
+    
+    for(bool batched : {false, true})
+    {
+        ofxOscSenderReceiverSettings settings;
+        settings.host = "localhost";
+        settings.nativeSocket = true;
+        settings.outPort = 57134;
+        settings.inPort = 57133;
+        ofxOscSenderReceiver sender;
+        sender.setup(settings);
+        settings.outPort = 57133;
+        settings.inPort = 57134;
+        ofxOscSenderReceiver receiver;
+        receiver.setup(settings);
+        
+        size_t received = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < numDatagrams; i += batchSize){
+            if(batched) sender.beginBatch();
+            for(int j = 0; j < batchSize; j++){
+                sender.sendMessage(set, true);
+            }
+            if(batched) sender.endBatch();
+            received += receiver.getNextMessages([](ofxOscMessage &){});
+        }
+        double elapsed = secondsSince(start);
+        
+        // let the receiver catch up before counting
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        received += receiver.getNextMessages([](ofxOscMessage &){});
+        
+        ofxSCTransmitStats stats = sender.getTransmitStats();
+        ofLogNotice("benchBatchedTransmit") << (batched ? "batched: " : "unbatched: ")
+            << stats.sendCalls << " syscalls for " << stats.datagrams << " datagrams, "
+            << stats.datagrams / elapsed << " datagrams/s, "
+            << stats.bytes / elapsed / 1e6 << " MB/s, "
+            << received << " received, " << receiver.getNumDroppedMessages() << " dropped by the receive queue";
+    }
+}
+
+//--------------------------------------------------------------
+// A storm of /n_end replies received by oscpack's listener and by the native
+// socket (recvmmsg on Linux). CPU time is for the whole process, sender included,
+// so compare the two rather than reading them as absolutes.
+//--------------------------------------------------------------
+
+void ofApp::benchReplyStorm()
+{
+    const int numReplies = 200000;
+    const int batchSize = 64;
+    
+    ofxOscMessage reply;
+    reply.setAddress("/n_end");
+    for(int i = 0; i < 5; i++) reply.addIntArg(1000 + i);
+    
+    for(bool native : {false, true})
+    {
+        ofxOscSenderReceiverSettings settings;
+        settings.host = "localhost";
+        settings.nativeSocket = true;
+        settings.outPort = 57136;
+        settings.inPort = 57135;
+        ofxOscSenderReceiver sender;
+        sender.setup(settings);
+        settings.nativeSocket = native;
+        settings.outPort = 57135;
+        settings.inPort = 57136;
+        ofxOscSenderReceiver receiver;
+        receiver.setup(settings);
+        
+        size_t received = 0;
+        std::clock_t cpuStart = std::clock();
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < numReplies; i += batchSize){
+            sender.beginBatch();
+            for(int j = 0; j < batchSize; j++){
+                sender.sendMessage(reply);
+            }
+            sender.endBatch();
+            received += receiver.getNextMessages([](ofxOscMessage &){});
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        received += receiver.getNextMessages([](ofxOscMessage &){});
+        double elapsed = secondsSince(start);
+        double cpu = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        
+        ofxSCReceiveStats stats = receiver.getReceiveStats();
+        ofLogNotice("benchReplyStorm") << (native ? "native: " : "oscpack: ")
+            << received << " of " << numReplies << " received, "
+            << cpu * 1e3 << " ms CPU in " << elapsed * 1e3 << " ms"
+            << (native ? ", " + ofToString(stats.datagrams / std::max<double>(stats.receiveCalls, 1)) + " datagrams per syscall" : "");
+    }
+}
+
+#ifdef OFXSC_HAS_NATIVE_SOCKETS
+//--------------------------------------------------------------
+// accepts one TCP connection and counts what arrives, standing in for scsynth -t
+class TcpSink
+{
+public:
+    TcpSink(int port){
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        bind(listenFd, (sockaddr*)&address, sizeof(address));
+        listen(listenFd, 1);
+        thread = std::thread([this]{
+            int fd = accept(listenFd, nullptr, nullptr);
+            if(fd < 0) return;
+            std::vector<char> buffer(1 << 16);
+            ssize_t n;
+            while((n = recv(fd, buffer.data(), buffer.size(), 0)) > 0) bytes += n;
+            ::close(fd);
+        });
+    }
+    ~TcpSink(){
+        // unblocks accept, the sender closing its end unblocks recv
+        shutdown(listenFd, SHUT_RDWR);
+        ::close(listenFd);
+        thread.join();
+    }
+    std::atomic<uint64_t> bytes{0};
+private:
+    int listenFd;
+    std::thread thread;
+};
+#endif
+
+//--------------------------------------------------------------
+// A 4 MB upload of /b_setn messages in one bundle: split into datagrams over UDP,
+// one length prefixed packet over TCP. Throughput is measured until the last byte
+// arrives at a local sink.
+//--------------------------------------------------------------
+
+void ofApp::benchBulkTransfer()
+{
+#ifdef OFXSC_HAS_NATIVE_SOCKETS
+    const int numMessages = 1000;
+    const int numFrames = 1024;
+    
+    ofxOscBundle bundle;
+    for(int i = 0; i < numMessages; i++){
+        ofxOscMessage m;
+        m.setAddress("/b_setn");
+        m.addIntArg(0);
+        m.addIntArg(i * numFrames);
+        m.addIntArg(numFrames);
+        for(int j = 0; j < numFrames; j++) m.addFloatArg(ofRandom(-1, 1));
+        bundle.addMessage(m);
+    }
+    size_t payload = ofxOscSenderReceiver::getEncodedSize(bundle);
+    
+    for(bool tcp : {false, true})
+    {
+        int port = tcp ? 57142 : 57140;
+        std::unique_ptr<TcpSink> tcpSink;
+        ofxOscSenderReceiver udpSink;
+        if(tcp){
+            tcpSink.reset(new TcpSink(port));
+        }else{
+            ofxOscSenderReceiverSettings settings;
+            settings.host = "localhost";
+            settings.nativeSocket = true;
+            settings.inPort = port;
+            settings.outPort = port + 1;
+            udpSink.setup(settings);
+        }
+        auto received = [&]() -> uint64_t {
+            return tcp ? tcpSink->bytes.load() : udpSink.getReceiveStats().bytes;
+        };
+        
+        std::unique_ptr<ofxSCServer> server(new ofxSCServer("localhost", port, port + 1));
+        if(tcp && !server->setTCP(true)) continue;
+        
+        auto start = std::chrono::steady_clock::now();
+        server->sendBundle(bundle);
+        // wait for the last byte, or give up on what UDP lost
+        uint64_t last = 0;
+        auto lastChange = std::chrono::steady_clock::now();
+        while(received() < payload && secondsSince(lastChange) < 0.5){
+            if(received() != last){
+                last = received();
+                lastChange = std::chrono::steady_clock::now();
+            }
+            std::this_thread::yield();
+        }
+        double elapsed = secondsSince(start) - (received() < payload ? 0.5 : 0);
+        server.reset();
+        
+        ofLogNotice("benchBulkTransfer") << (tcp ? "TCP: " : "UDP: ")
+            << received() << " bytes arrived for a " << payload << " byte bundle, "
+            << received() / elapsed / 1e6 << " MB/s";
+    }
+#endif
+}
+
+//--------------------------------------------------------------
+// Serialization and dispatch through an in-process transport, no kernel involved:
+// /n_set encoded and handed to a function, /n_end packets decoded and routed to
+// their nodes.
+//--------------------------------------------------------------
+
+void ofApp::benchLoopback()
+{
+    const int numSends = 200000;
+    const int numNodes = 1000;
+    
+    BenchServer server("localhost", 57110, 57137);
+    size_t sentBytes = 0;
+    ofxSCLoopbackTransport *transport = new ofxSCLoopbackTransport([&](const char *data, size_t size){
+        sentBytes += size;
+    });
+    server.setTransport(std::unique_ptr<ofxSCTransport>(transport));
+    
+    std::vector<std::unique_ptr<ofxSCSynth>> synths;
+    for(int i = 0; i < numNodes; i++){
+        synths.emplace_back(new ofxSCSynth("sine", &server));
+        synths.back()->create();
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < numSends; i++){
+        synths[i % numNodes]->set("freq", 440 + i % 100);
+    }
+    double elapsed = secondsSince(start);
+    ofLogNotice("benchLoopback") << "send /n_set: " << elapsed * 1e9 / numSends << " ns/msg, "
+        << sentBytes / numSends << " bytes/msg";
+    
+    // pre-encoded /n_end replies, one per node
+    std::vector<std::vector<char>> replies;
+    for(auto &synth : synths){
+        char buffer[64];
+        osc::OutboundPacketStream p(buffer, sizeof(buffer));
+        p << osc::BeginMessage("/n_end") << (osc::int32)synth->nodeID << (osc::int32)1 << (osc::int32)-1 << (osc::int32)-1 << (osc::int32)0 << osc::EndMessage;
+        replies.emplace_back(p.Data(), p.Data() + p.Size());
+    }
+    
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < numSends; i++){
+        const std::vector<char> &reply = replies[i % numNodes];
+        transport->receive(reply.data(), reply.size());
+        // drain before the receive queue fills up
+        if(i % 1024 == 1023) server.process();
+    }
+    server.process();
+    elapsed = secondsSince(start);
+    ofLogNotice("benchLoopback") << "receive and dispatch /n_end: " << elapsed * 1e9 / numSends << " ns/msg";
+}
+
+//--------------------------------------------------------------
+// An ofxSCServer talking to the mock server, over UDP on localhost or through
+// an in-process transport, with node notifications on and status polling off.
+class MockSession
+{
+public:
+    MockSession(ofxSCMockServer &mock, bool udp, int port) : server("localhost", port, port + 1)
+    {
+        ofxSCStatusPollSettings poll;
+        poll.enabled = false;
+        server.setStatusPollSettings(poll);
+        if(!udp) server.setTransport(mock.createTransport());
+        server.addReplyHandler("/synced", [this](ofxOscMessage &m){ lastSynced = m.getArgAsInt(0); });
+        server.notify();
+        sync();
+    }
+    
+    /// send /sync and process replies until it comes back
+    /// \return the round trip in seconds, or -1 after a timeout
+    double sync()
+    {
+        int id = nextSyncID++;
+        ofxOscMessage m;
+        m.setAddress("/sync");
+        m.addIntArg(id);
+        auto start = std::chrono::steady_clock::now();
+        server.sendMsg(m);
+        return waitFor([&]{ return lastSynced == id; }, start);
+    }
+    
+    /// process replies until done() is true
+    /// \return seconds since start, or -1 if it took more than a second
+    template<typename F>
+    double waitFor(F done, std::chrono::steady_clock::time_point start)
+    {
+        while(!done()){
+            server.process();
+            if(secondsSince(start) > 1) return -1;
+            std::this_thread::yield();
+        }
+        return secondsSince(start);
+    }
+    
+    uint64_t getBytesSent() const
+    {
+        return server.getTransport() ? server.getTransport()->getStats().bytes : 0;
+    }
+    
+    BenchServer server;
+    
+private:
+    // clear of the id the server uses for its own initialization /sync
+    int nextSyncID = 100000;
+    int lastSynced = -1;
+};
+
+//--------------------------------------------------------------
+// times workload and fills in what it doesn't count itself
+template<typename F>
+static BenchResult measureWorkload(const std::string &name, bool udp, MockSession &session, F workload)
+{
+    BenchResult result;
+    result.name = name;
+    result.transport = udp ? "udp" : "inprocess";
+    uint64_t bytes = session.getBytesSent();
+    uint64_t allocations = benchThreadAllocations();
+    auto start = std::chrono::steady_clock::now();
+    workload(result);
+    result.seconds = secondsSince(start);
+    result.allocations = benchThreadAllocations() - allocations;
+    result.bytes = session.getBytesSent() - bytes;
+    return result;
+}
+
+//--------------------------------------------------------------
+// End to end control path against a mock scsynth, through ofxSCSynth, ofxSCBus,
+// ofxSCBuffer and ofxSCServer::process like an app would:
+//  - grainStorm: bursts of 200 short synths, /s_new then /n_free, a /sync behind each burst
+//  - voiceSweep: /n_set on 10000 running voices, sent as a stored bundle, a /sync per sweep
+//  - busPolling: /c_get on one of 64 control busses, round trip until its /c_set is back
+//  - busPipelined: the same with up to 32 requests in flight, each answered through its callback
+//  - bufferUpload: 4 MB into a buffer as /b_setn of 1024 frames, a /sync every 64 of them
+// Latency is the round trip of those /sync or /c_get requests, each waiting behind the
+// work sent before it. Allocations are counted on the app thread only.
+//--------------------------------------------------------------
+
+void ofApp::benchControlPath()
+{
+    const int port = 57150;
+    std::vector<BenchResult> results;
+    
+    for(bool udp : {true, false})
+    {
+        ofxSCMockServerSettings settings;
+        settings.port = port;
+        ofxSCMockServer mock(settings);
+        if(udp && !mock.start()) continue;
+        
+        {
+            MockSession session(mock, udp, port + 1);
+            results.push_back(measureWorkload("grainStorm", udp, session, [&](BenchResult &r){
+                const int numBursts = 100;
+                const int grainsPerBurst = 200;
+                for(int burst = 0; burst < numBursts; burst++){
+                    std::vector<std::unique_ptr<ofxSCSynth>> grains;
+                    for(int i = 0; i < grainsPerBurst; i++){
+                        grains.emplace_back(new ofxSCSynth("grain", &session.server));
+                        grains.back()->set("freq", 200 + 10 * i);
+                        grains.back()->set("dur", 0.05);
+                        grains.back()->create();
+                    }
+                    for(auto &grain : grains) grain->free();
+                    r.addRoundTrip(session.sync());
+                    r.messages += 2 * grainsPerBurst + 1;
+                }
+            }));
+        }
+        mock.reset();
+        
+        {
+            MockSession session(mock, udp, port + 1);
+            const int numVoices = 10000;
+            const int chunk = 1000;
+            std::vector<std::unique_ptr<ofxSCSynth>> voices;
+            // created in chunks so the /n_go replies fit the receive queue, set() needs them
+            for(int i = 0; i < numVoices; i += chunk){
+                for(int j = 0; j < chunk; j++){
+                    voices.emplace_back(new ofxSCSynth("voice", &session.server));
+                    voices.back()->create();
+                }
+                session.sync();
+            }
+            results.push_back(measureWorkload("voiceSweep", udp, session, [&](BenchResult &r){
+                const int numSweeps = 20;
+                for(int sweep = 0; sweep < numSweeps; sweep++){
+                    session.server.setWaitToSend(true);
+                    for(int i = 0; i < numVoices; i++){
+                        voices[i]->set("freq", 100 + sweep * 10 + i % 100);
+                    }
+                    session.server.sendStoredBundle();
+                    session.server.setWaitToSend(false);
+                    r.addRoundTrip(session.sync());
+                    r.messages += numVoices + 1;
+                }
+            }));
+            if(mock.getNumSynths() != numVoices){
+                ofLogWarning("voiceSweep") << "mock has " << mock.getNumSynths() << " of " << numVoices << " voices";
+            }
+        }
+        mock.reset();
+        
+        {
+            MockSession session(mock, udp, port + 1);
+            const int numBusses = 64;
+            std::vector<std::unique_ptr<ofxSCBus>> busses;
+            for(int i = 0; i < numBusses; i++){
+                busses.emplace_back(new ofxSCBus(RATE_CONTROL, 1, &session.server));
+                busses.back()->set(i * 0.1);
+            }
+            int lastIndex = -1;
+            session.server.addReplyHandler("/c_set", [&](ofxOscMessage &m){ lastIndex = m.getArgAsInt(0); });
+            session.sync();
+            results.push_back(measureWorkload("busPolling", udp, session, [&](BenchResult &r){
+                const int numPolls = 5000;
+                for(int i = 0; i < numPolls; i++){
+                    ofxSCBus &bus = *busses[i % numBusses];
+                    lastIndex = -1;
+                    auto start = std::chrono::steady_clock::now();
+                    bus.requestValues();
+                    r.addRoundTrip(session.waitFor([&]{ return lastIndex == bus.index; }, start));
+                    r.messages++;
+                }
+            }));
+            results.push_back(measureWorkload("busPipelined", udp, session, [&](BenchResult &r){
+                const int numPolls = 5000;
+                const int maxInFlight = 32;
+                int inFlight = 0;
+                int sent = 0;
+                while(sent < numPolls || inFlight > 0){
+                    for(; sent < numPolls && inFlight < maxInFlight; sent++){
+                        auto start = std::chrono::steady_clock::now();
+                        inFlight++;
+                        busses[sent % numBusses]->requestValues([&r, &inFlight, start](const ofxSCReply &reply){
+                            r.addRoundTrip(reply.ok ? secondsSince(start) : -1);
+                            inFlight--;
+                        });
+                        r.messages++;
+                    }
+                    session.server.process();
+                    std::this_thread::yield();
+                }
+            }));
+        }
+        mock.reset();
+        
+        {
+            MockSession session(mock, udp, port + 1);
+            const int numFrames = 1 << 20;
+            const int framesPerMessage = 1024;
+            ofxSCBuffer buffer(numFrames, 1, &session.server);
+            buffer.alloc();
+            session.sync();
+            std::vector<float> samples(framesPerMessage);
+            for(auto &s : samples) s = ofRandom(-1, 1);
+            results.push_back(measureWorkload("bufferUpload", udp, session, [&](BenchResult &r){
+                for(int frame = 0; frame < numFrames; frame += framesPerMessage){
+                    ofxOscMessage m;
+                    m.setAddress("/b_setn");
+                    m.addIntArg(buffer.index);
+                    m.addIntArg(frame);
+                    m.addIntArg(framesPerMessage);
+                    for(float s : samples) m.addFloatArg(s);
+                    session.server.sendMsg(m);
+                    r.messages++;
+                    if((frame / framesPerMessage) % 64 == 63){
+                        r.addRoundTrip(session.sync());
+                        r.messages++;
+                    }
+                }
+            }));
+            buffer.free();
+        }
+        
+        ofxSCMockServerStats stats = mock.getStats();
+        ofLogNotice("benchControlPath") << (udp ? "udp" : "inprocess") << ": mock handled "
+            << stats.messagesHandled << " messages in " << stats.packetsReceived << " packets, "
+            << stats.packetsDropped << " dropped";
+    }
+    
+    writeBenchResults(ofToDataPath("control-path.jsonl", true), results);
+}
+
+//--------------------------------------------------------------
+// timetags as ofxSCServer made them before ofxSCTimetagClock: system clock
+// truncated to milliseconds
+static uint64_t millisecondTimetag()
+{
+    auto sinceEpoch = std::chrono::system_clock::now().time_since_epoch();
+    uint64_t milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(sinceEpoch).count() + 2208988800000ULL;
+    return ((milliseconds / 1000) << 32) + uint32_t(4294967.296 * (milliseconds % 1000));
+}
+
+//--------------------------------------------------------------
+// Timetags taken every 250 us, like a dense grain stream. The spacing between
+// consecutive timetags is compared to the spacing measured on steady_clock,
+// any difference is jitter the server would play.
+//--------------------------------------------------------------
+
+void ofApp::benchTimetagJitter()
+{
+    const int numEvents = 4000;
+    const auto period = std::chrono::microseconds(250);
+    
+    ofxSCTimetagClock clock;
+    
+    for(bool highResolution : {false, true})
+    {
+        std::vector<uint64_t> timetags(numEvents);
+        std::vector<std::chrono::steady_clock::time_point> times(numEvents);
+        auto next = std::chrono::steady_clock::now();
+        for(int i = 0; i < numEvents; i++){
+            next += period;
+            while(std::chrono::steady_clock::now() < next){}
+            times[i] = std::chrono::steady_clock::now();
+            timetags[i] = highResolution ? clock.getTimetag() : millisecondTimetag();
+        }
+        
+        double sumSquares = 0;
+        double worst = 0;
+        for(int i = 1; i < numEvents; i++){
+            double tagged = double(int64_t(timetags[i] - timetags[i - 1])) / 4294967296.0;
+            double measured = std::chrono::duration<double>(times[i] - times[i - 1]).count();
+            double error = tagged - measured;
+            sumSquares += error * error;
+            worst = std::max(worst, std::abs(error));
+        }
+        
+        const int numCalls = 1000000;
+        uint64_t sink = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < numCalls; i++){
+            sink += highResolution ? clock.getTimetag() : millisecondTimetag();
+        }
+        double elapsed = secondsSince(start);
+        
+        ofLogNotice("benchTimetagJitter") << (highResolution ? "ofxSCTimetagClock: " : "milliseconds: ")
+            << "rms " << std::sqrt(sumSquares / (numEvents - 1)) * 1e6 << " us, worst "
+            << worst * 1e6 << " us, " << elapsed * 1e9 / numCalls << " ns/timetag"
+            << (sink == 0 ? " " : "");
+    }
+}
+
+//--------------------------------------------------------------
+// Grains triggered from a stand-in audio callback: blocks of 64 /s_new, /n_set
+// and /n_free on their own thread, through ofxSCRealtimeSender and through
+// ofxSCSynth for comparison, while this thread sends. The real-time path must
+// not allocate, any allocation on that thread is reported as an error.
+//--------------------------------------------------------------
+
+void ofApp::benchRealtimeSend()
+{
+    const int numBlocks = 2000;
+    const int grainsPerBlock = 64;
+    
+    BenchServer server("localhost", 57110, 57138);
+    ofxSCStatusPollSettings poll;
+    poll.enabled = false;
+    server.setStatusPollSettings(poll);
+    server.startIOThread();
+    // allocates its queue, so not in the callback
+    ofxSCRealtimeSender &sender = server.getRealtimeSender();
+    
+    for(bool realtime : {true, false})
+    {
+        uint64_t allocations = 0;
+        double elapsed = 0;
+        std::thread audio([&]{
+            ofxSCControlValue controls[] = {{"freq", 440}, {"amp", 0.1}, {"pan", 0}};
+            uint64_t start = benchThreadAllocations();
+            auto startTime = std::chrono::steady_clock::now();
+            for(int block = 0; block < numBlocks; block++){
+                int nodeIDs[grainsPerBlock];
+                for(int i = 0; i < grainsPerBlock; i++){
+                    if(realtime){
+                        nodeIDs[i] = sender.synthNew("grain", 0, 1, controls, 3);
+                        sender.nodeSet(nodeIDs[i], "freq", 200 + 10 * i);
+                    }else{
+                        ofxSCSynth grain("grain", &server);
+                        grain.set("freq", 440);
+                        grain.set("amp", 0.1);
+                        grain.set("pan", 0);
+                        grain.create();
+                        grain.set("freq", 200 + 10 * i);
+                        nodeIDs[i] = grain.nodeID;
+                    }
+                }
+                for(int i = 0; i < grainsPerBlock; i++){
+                    if(realtime){
+                        sender.nodeFree(nodeIDs[i]);
+                    }else{
+                        ofxOscMessage m;
+                        m.setAddress("/n_free");
+                        m.addIntArg(nodeIDs[i]);
+                        server.sendMsg(m);
+                    }
+                }
+                // give the I/O thread room, like the time between two callbacks
+                while(!sender.empty()) std::this_thread::yield();
+            }
+            elapsed = secondsSince(startTime);
+            allocations = benchThreadAllocations() - start;
+        });
+        audio.join();
+        
+        uint64_t numCalls = (uint64_t)numBlocks * grainsPerBlock * 3;
+        double perCall = double(allocations) / numCalls;
+        ofLogNotice("benchRealtimeSend") << (realtime ? "ofxSCRealtimeSender: " : "ofxSCSynth: ")
+            << elapsed * 1e9 / numCalls << " ns/call, " << perCall << " allocations/call";
+        if(realtime && allocations > 0){
+            ofLogError("benchRealtimeSend") << allocations << " allocations on the real-time path, expected none";
+        }
+    }
+    ofLogNotice("benchRealtimeSend") << "dropped: " << sender.getNumDropped();
+    server.stopIOThread();
+}
+
+//--------------------------------------------------------------
+// call fn(const osc::ReceivedMessage&) for every message in a packet, nested bundles included
+template<typename F>
+static void forEachMessage(const osc::ReceivedBundle &bundle, F &fn)
+{
+    for(auto it = bundle.ElementsBegin(); it != bundle.ElementsEnd(); ++it){
+        if(it->IsBundle()) forEachMessage(osc::ReceivedBundle(*it), fn);
+        else fn(osc::ReceivedMessage(*it));
+    }
+}
+
+template<typename F>
+static void forEachMessage(const char *data, size_t size, F fn)
+{
+    osc::ReceivedPacket packet(data, (osc::osc_bundle_element_size_t)size);
+    if(packet.IsBundle()) forEachMessage(osc::ReceivedBundle(packet), fn);
+    else fn(osc::ReceivedMessage(packet));
+}
+
+//--------------------------------------------------------------
+// Multi-producer stress test without the I/O thread: worker threads send and
+// write coalesced busses while this thread runs process() like an update loop.
+// The loopback transport isn't thread safe, so the workers queue for process().
+// Every message must reach the transport from this thread only, exactly once
+// and in the order its worker sent it, and every bus must end on its last
+// value. Anything else is reported as an error.
+//--------------------------------------------------------------
+
+void ofApp::benchMultiProducer()
+{
+    const int numProducers = 4;
+    const int numMessages = 50000;
+    
+    BenchServer server("localhost", 57110, 57139);
+    ofxSCStatusPollSettings poll;
+    poll.enabled = false;
+    server.setStatusPollSettings(poll);
+    server.setCoalescing(true);
+    
+    // only ever called from this thread if the server keeps to its owner
+    std::thread::id owner = std::this_thread::get_id();
+    std::vector<int> lastSeen(numProducers, -1);
+    std::vector<float> busValues(numProducers, -1);
+    uint64_t received = 0, outOfOrder = 0, busRegressions = 0;
+    std::atomic<uint64_t> wrongThread(0);
+    server.setTransport(std::unique_ptr<ofxSCTransport>(new ofxSCLoopbackTransport([&](const char *data, size_t size){
+        if(std::this_thread::get_id() != owner){
+            wrongThread++;
+            return;
+        }
+        forEachMessage(data, size, [&](const osc::ReceivedMessage &m){
+            auto arg = m.ArgumentsBegin();
+            if(std::strcmp(m.AddressPattern(), "/bench") == 0){
+                int producer = arg->AsInt32();
+                int sequence = (++arg)->AsInt32();
+                if(sequence != lastSeen[producer] + 1) outOfOrder++;
+                lastSeen[producer] = sequence;
+                received++;
+            }else if(std::strcmp(m.AddressPattern(), "/c_set") == 0){
+                while(arg != m.ArgumentsEnd()){
+                    int index = arg->AsInt32();
+                    float value = (++arg)->AsFloat();
+                    ++arg;
+                    if(index < 0 || index >= numProducers) continue;
+                    if(value < busValues[index]) busRegressions++;
+                    busValues[index] = value;
+                }
+            }
+        });
+    })));
+    
+    std::atomic<int> running(numProducers);
+    std::vector<std::thread> producers;
+    auto start = std::chrono::steady_clock::now();
+    for(int p = 0; p < numProducers; p++){
+        producers.emplace_back([&, p]{
+            for(int i = 0; i < numMessages; i++){
+                ofxOscMessage m;
+                m.setAddress("/bench");
+                m.addIntArg(p);
+                m.addIntArg(i);
+                server.sendMsg(m);
+                server.coalesceBus(p, i);
+            }
+            running--;
+        });
+    }
+    while(running > 0){
+        server.process();
+        std::this_thread::yield();
+    }
+    for(auto &producer : producers) producer.join();
+    server.process();
+    double elapsed = secondsSince(start);
+    
+    uint64_t expected = (uint64_t)numProducers * numMessages;
+    ofLogNotice("benchMultiProducer") << numProducers << " threads: " << elapsed * 1e9 / expected << " ns/msg, "
+        << received << " of " << expected << " received, " << server.getCoalescingStats().collapsed << " bus writes collapsed";
+    bool busesFinal = std::all_of(busValues.begin(), busValues.end(), [&](float v){ return v == numMessages - 1; });
+    if(received != expected || outOfOrder > 0 || wrongThread > 0 || busRegressions > 0 || !busesFinal){
+        ofLogError("benchMultiProducer") << server.getNumDroppedSends() << " dropped, " << outOfOrder << " out of order, " << wrongThread << " sent off the owner thread, "
+            << busRegressions << " bus values went back" << (busesFinal ? "" : ", busses didn't end on their last value");
+    }
+}
+
+//--------------------------------------------------------------
+// The allocator ofxSCResourceAllocator replaced: a bump pointer and one free
+// list per exact size, freed ranges are never split or merged.
+class ExactSizeAllocator
+{
+public:
+    explicit ExactSizeAllocator(int capacity) : capacity(capacity), pos(0), sizes(capacity, 0), freeLists(capacity + 1) {}
+    
+    int alloc(int size)
+    {
+        auto &list = freeLists[size];
+        if(!list.empty()){
+            int address = list.back();
+            list.pop_back();
+            numFree -= size;
+            return address;
+        }
+        if(pos + size > capacity) return -1;
+        sizes[pos] = size;
+        pos += size;
+        return pos - size;
+    }
+    
+    void free(int address)
+    {
+        freeLists[sizes[address]].push_back(address);
+        numFree += sizes[address];
+    }
+    
+    int getNumFree() const {return capacity - pos + numFree;}
+    int getLargestFree() const
+    {
+        int largest = capacity - pos;
+        for(int size = capacity; size > largest; size--){
+            if(!freeLists[size].empty()) return size;
+        }
+        return largest;
+    }
+    
+private:
+    int capacity;
+    int pos;
+    int numFree = 0;
+    std::vector<int> sizes;
+    std::vector<std::vector<int>> freeLists;
+};
+
+//--------------------------------------------------------------
+// Long randomized traces on 4096 control busses: mostly 1, 2, 4 and 8 channel
+// busses with some odd sizes up to 16, kept around 75% full with random frees.
+// Failures only count requests the free space could have served. Fragmentation
+// is 1 - largest free range / free indices, sampled every 1000 operations.
+//--------------------------------------------------------------
+
+template<typename Allocator>
+static void runAllocatorTrace(const std::string &name, Allocator &allocator, int capacity)
+{
+    const int numOperations = 2000000;
+    std::mt19937 random(42);
+    std::vector<std::pair<int, int>> live;
+    int used = 0;
+    uint64_t failures = 0;
+    double fragmentation = 0;
+    int numSamples = 0;
+    double sampling = 0;
+    
+    // the trace is drawn up front so only the allocator is timed
+    std::vector<int> sizes(numOperations);
+    std::vector<uint32_t> picks(numOperations);
+    const int commonSizes[] = {1, 1, 2, 2, 2, 4, 4, 8};
+    for(int i = 0; i < numOperations; i++){
+        sizes[i] = random() % 5 == 0 ? 1 + random() % 16 : commonSizes[random() % 8];
+        picks[i] = random();
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < numOperations; i++){
+        bool grow = used < capacity * 3 / 4 ? picks[i] % 4 != 0 : picks[i] % 4 == 0;
+        if(grow || live.empty()){
+            int address = allocator.alloc(sizes[i]);
+            if(address < 0){
+                if(allocator.getNumFree() >= sizes[i]) failures++;
+            }else{
+                live.emplace_back(address, sizes[i]);
+                used += sizes[i];
+            }
+        }else{
+            size_t index = picks[i] % live.size();
+            allocator.free(live[index].first);
+            used -= live[index].second;
+            live[index] = live.back();
+            live.pop_back();
+        }
+        if(i % 1000 == 999 && allocator.getNumFree() > 0){
+            auto sampleStart = std::chrono::steady_clock::now();
+            fragmentation += 1 - double(allocator.getLargestFree()) / allocator.getNumFree();
+            numSamples++;
+            sampling += secondsSince(sampleStart);
+        }
+    }
+    double elapsed = secondsSince(start) - sampling;
+    
+    ofLogNotice("benchResourceAllocator") << name << ": " << elapsed * 1e9 / numOperations << " ns/op, "
+        << failures << " failures with room left, fragmentation " << fragmentation / std::max(numSamples, 1);
+}
+
+void ofApp::benchResourceAllocator()
+{
+    const int capacity = 4096;
+    {
+        ExactSizeAllocator allocator(capacity);
+        runAllocatorTrace("exact size free lists", allocator, capacity);
+    }
+    {
+        ofxSCResourceAllocator allocator(capacity);
+        runAllocatorTrace("ofxSCResourceAllocator", allocator, capacity);
+    }
+    
+    // what a server pays up front for its three default 65536 entry allocators
+    const int numServers = 1000;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < numServers; i++){
+        ofxSCResourceAllocator audio(65536, 64), control(65536), buffers(65536);
+    }
+    double seconds = secondsSince(start);
+    ofLogNotice("benchResourceAllocator") << "constructing the allocators of a server: " << seconds * 1e6 / numServers << " us";
+    
+    // and once it's used, memory follows the indices handed out
+    ofxSCResourceAllocator audio(65536, 64);
+    ofxSCPagedTable<int> busses;
+    for(int i = 0; i < 100; i++) busses.set(audio.alloc(2), i + 1);
+    ofLogNotice("benchResourceAllocator") << "100 stereo busses: tags up to index " << audio.getHighWater()
+        << ", " << busses.getNumPages() << " table page(s) of " << ofxSCPagedTable<int>::pageSize;
+}
+
+//--------------------------------------------------------------
+// What new ofxSCServer costs before anything is sent: time, and allocations
+// and bytes on this thread (the listener thread's are its own). The queues
+// are allocated on first use, so the bytes should stay far below what they'd
+// take: over 1 MB is reported as an error.
+//--------------------------------------------------------------
+
+void ofApp::benchServerConstruction()
+{
+    const int numServers = 50;
+    
+    double seconds = 0;
+    uint64_t allocations = 0, bytes = 0;
+    for(int i = 0; i < numServers; i++){
+        uint64_t startAllocations = benchThreadAllocations();
+        uint64_t startBytes = benchThreadAllocatedBytes();
+        auto start = std::chrono::steady_clock::now();
+        ofxSCServer *server = new ofxSCServer("localhost", 57110, 57143);
+        seconds += secondsSince(start);
+        allocations += benchThreadAllocations() - startAllocations;
+        bytes += benchThreadAllocatedBytes() - startBytes;
+        delete server;
+    }
+    ofLogNotice("benchServerConstruction") << "new ofxSCServer: " << seconds * 1e6 / numServers << " us, "
+        << allocations / numServers << " allocations, " << bytes / numServers / 1024 << " KB";
+    if(bytes / numServers > 1024 * 1024){
+        ofLogError("benchServerConstruction") << bytes / numServers << " bytes per server, are the queues allocated up front?";
+    }
+    
+    // what the real-time path adds once it's asked for
+    ofxSCServer server("localhost", 57110, 57143);
+    uint64_t startBytes = benchThreadAllocatedBytes();
+    server.getRealtimeSender();
+    ofLogNotice("benchServerConstruction") << "getRealtimeSender(): " << (benchThreadAllocatedBytes() - startBytes) / 1024 << " KB";
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxSuperCollider.h"
+
+/*------------------------------------------------------------------------------
+ * Micro benchmarks for the control path of ofxSuperCollider.
+ *
+ * No SuperCollider server is needed, everything that goes out is sent to
+ * localhost and ignored, or answered by ofxSCMockServer. Results are printed
+ * to the console and the app exits when done. The end-to-end control path
+ * runs are also written to bin/data/control-path.jsonl for regression tracking.
+ *------------------------------------------------------------------------------*/
+
+class ofApp : public ofBaseApp
+{
+    
+public:
+    void setup();
+    
+    void benchNodeDispatch();
+    void benchReceiveQueue();
+    void benchEncode();
+    void benchBatchedTransmit();
+    void benchReplyStorm();
+    void benchBulkTransfer();
+    void benchLoopback();
+    void benchControlPath();
+    void benchTimetagJitter();
+    void benchRealtimeSend();
+    void benchMultiProducer();
+    void benchResourceAllocator();
+    void benchServerConstruction();
+};
@@ -11,6 +11,28 @@
 
 #include "ofxOscSenderReceiver.h"
 
+#include <cstring>
+
+// Encoding scratch space, one per thread so any thread can send. It is sized
+// from the encoded size of what is being sent and only ever grows, so after
+// the first few sends encoding doesn't allocate.
+static char *getEncodeBuffer(size_t size){
+    thread_local std::vector<char> buffer;
+    if(buffer.size() < size){
+        buffer.resize(size);
+    }
+    return buffer.data();
+}
+
+static size_t paddedLength(size_t length){
+    return (length + 3) & ~size_t(3);
+}
+
+// bundle header: "#bundle\0" and the timetag
+static const size_t BUNDLE_HEADER_SIZE = 16;
+// every bundle element is prefixed by its size
+static const size_t BUNDLE_ELEMENT_SIZE = 4;
+
 //--------------------------------------------------------------
 ofxOscSenderReceiver::~ofxOscSenderReceiver() {
     clear();
@@ -31,7 +53,7 @@ ofxOscSenderReceiver& ofxOscSenderReceiver::operator=(const ofxOscSenderReceiver
 ofxOscSenderReceiver& ofxOscSenderReceiver::copy(const ofxOscSenderReceiver& other){
     if(this == &other) return *this;
     settings = other.settings;
-    if(other.sendSocket){
+    if(other.canSend()){
         setup(settings);
     }
     return *this;
@@ -39,9 +61,6 @@ ofxOscSenderReceiver& ofxOscSenderReceiver::copy(const ofxOscSenderReceiver& oth
 
 //--------------------------------------------------------------
 bool ofxOscSenderReceiver::setup(const std::string &host, int outPort, int inPort){
-    if(listenSocket){
-        stop();
-    }
     settings.host = host;
     settings.outPort = outPort;
     settings.inPort = inPort;
@@ -55,6 +74,10 @@ bool ofxOscSenderReceiver::setup(const ofxOscSenderReceiverSettings &settings){
        osc::UdpSocket::SetUdpBufferSize(65535);
     }
     
+    // a previous socket and its thread go first
+    stop();
+    clear();
+    
     this->settings = settings;
     
     // check for empty host
@@ -63,19 +86,28 @@ bool ofxOscSenderReceiver::setup(const ofxOscSenderReceiverSettings &settings){
         return false;
     }
     
+#ifdef OFXSC_HAS_NATIVE_SOCKETS
+    if(settings.tcp){
+        ofxSCTcpSocket *tcpSocket = new ofxSCTcpSocket();
+        std::unique_ptr<ofxSCTransport> socket(tcpSocket);
+        if(!tcpSocket->open(settings.host, settings.outPort)){
+            return false;
+        }
+        return setTransport(std::move(socket));
+    }else if(settings.nativeSocket){
+        ofxSCUdpSocket *udpSocket = new ofxSCUdpSocket();
+        std::unique_ptr<ofxSCTransport> socket(udpSocket);
+        if(!udpSocket->open(settings.host, settings.outPort, settings.inPort, settings.reuse)){
+            return false;
+        }
+        return setTransport(std::move(socket));
+    }
+#endif
     
     // create socket
-    osc::UdpListeningReceiveSocket *socket = nullptr;
     try{
         osc::IpEndpointName name(osc::IpEndpointName::ANY_ADDRESS, settings.inPort);
-        socket = new osc::UdpListeningReceiveSocket(name, this, settings.reuse);
-        auto deleter = [](osc::UdpListeningReceiveSocket*socket){
-            // tell the socket to shutdown
-            socket->Break();
-            delete socket;
-        };
-        auto newPtr = std::unique_ptr<osc::UdpListeningReceiveSocket, decltype(deleter)>(socket, deleter);
-        listenSocket = std::move(newPtr);
+        listenSocket.reset(new osc::UdpListeningReceiveSocket(name, this, settings.reuse));
     }
     catch(std::exception &e){
         std::string what = e.what();
@@ -85,40 +117,21 @@ bool ofxOscSenderReceiver::setup(const ofxOscSenderReceiverSettings &settings){
         }
         ofLogError("ofxOscSenderReceiver") << "couldn't create receiver on port "
                                      << settings.inPort << ": " << what;
-        if(socket != nullptr){
-            delete socket;
-            socket = nullptr;
-        }
         return false;
     }
-
-    listenThread = std::thread([this]{
-        while(listenSocket){
-            try{
-                listenSocket->Run();
-            }
-            catch(std::exception &e){
-                ofLogWarning("ofxOscSenderReceiver") << e.what();
-            }
-        }
-    });
-
-    // detach thread so we don't have to wait on it before creating a new socket
-    // or on destruction, the custom deleter for the socket unique_ptr already
-    // does the right thing
-    listenThread.detach();
     
-    // reuse socket
-    osc::UdpTransmitSocket *send_socket = (osc::UdpTransmitSocket *) socket;
+    // reuse socket, connected before the listener thread starts using it
+    osc::UdpTransmitSocket *send_socket = (osc::UdpTransmitSocket *) listenSocket.get();
     try{
         osc::IpEndpointName name = osc::IpEndpointName(settings.host.c_str(), settings.outPort);
         if (!name.address){
                 ofLogError("ofxOscSender") << "bad host? " << settings.host;
+                listenSocket.reset();
                 return false;
         }
 //        socket = new osc::UdpTransmitSocket(name, settings.broadcast);
         send_socket->Connect(name);
-        sendSocket.reset(send_socket);
+        sendSocket = send_socket;
     }
     catch(std::exception &e){
         std::string what = e.what();
@@ -129,64 +142,181 @@ bool ofxOscSenderReceiver::setup(const ofxOscSenderReceiverSettings &settings){
         ofLogError("ofxOscSender") << "couldn't create sender to "
                                    << settings.host << " on port "
                                    << settings.outPort << ": " << what;
-        if(socket != nullptr){
-            delete send_socket;
-            send_socket = nullptr;
-        }
-        sendSocket.reset();
+        listenSocket.reset();
         return false;
     }
+
+    // Run() only returns once stop() breaks it, an exception from a bad packet
+    // just restarts it. The thread is joined in stop() before the socket goes.
+    osc::UdpListeningReceiveSocket *socket = listenSocket.get();
+    std::promise<void> done;
+    listenThreadDone = done.get_future();
+    listenThread = std::thread([socket](std::promise<void> done){
+        for(;;){
+            try{
+                socket->Run();
+                break;
+            }
+            catch(std::exception &e){
+                ofLogWarning("ofxOscSenderReceiver") << e.what();
+            }
+        }
+        done.set_value();
+    }, std::move(done));
     
     return true;
 }
 
+//--------------------------------------------------------------
+bool ofxOscSenderReceiver::setTransport(std::unique_ptr<ofxSCTransport> _transport){
+    stop();
+    clear();
+    if(!_transport || !_transport->isOpen()){
+        ofLogError("ofxOscSenderReceiver") << "setTransport(): transport isn't open";
+        return false;
+    }
+    transport = std::move(_transport);
+    return transport->startReceiving([this](const char *data, size_t size, const osc::IpEndpointName &from){
+        try{
+            ProcessPacket(data, (int)size, from);
+        }
+        catch(std::exception &e){
+            ofLogWarning("ofxOscSenderReceiver") << "couldn't process packet: " << e.what();
+        }
+    });
+}
+
 //--------------------------------------------------------------
 void ofxOscSenderReceiver::clear(){
-    sendSocket.reset();
+    sendSocket = nullptr;
+    transport.reset();
+}
+
+//--------------------------------------------------------------
+void ofxOscSenderReceiver::beginBatch(){
+    if(transport) transport->beginBatch();
+}
+
+//--------------------------------------------------------------
+void ofxOscSenderReceiver::endBatch(){
+    if(transport) transport->endBatch();
+}
+
+//--------------------------------------------------------------
+ofxSCTransmitStats ofxOscSenderReceiver::getTransmitStats() const{
+    return transport ? transport->getStats() : ofxSCTransmitStats();
+}
+
+//--------------------------------------------------------------
+ofxSCReceiveStats ofxOscSenderReceiver::getReceiveStats() const{
+    return transport ? transport->getReceiveStats() : ofxSCReceiveStats();
+}
+
+//--------------------------------------------------------------
+bool ofxOscSenderReceiver::isPacketSizeLimited() const{
+    return transport ? transport->isPacketSizeLimited() : true;
+}
+
+//--------------------------------------------------------------
+bool ofxOscSenderReceiver::isThreadSafe() const{
+    return transport && transport->isThreadSafe();
+}
+
+//--------------------------------------------------------------
+bool ofxOscSenderReceiver::canSend() const{
+    return transport != nullptr || sendSocket != nullptr;
+}
+
+//--------------------------------------------------------------
+char *ofxOscSenderReceiver::getSendBuffer(size_t size){
+    return transport ? transport->reserve(size) : getEncodeBuffer(size);
+}
+
+//--------------------------------------------------------------
+void ofxOscSenderReceiver::sendPacket(const char *data, size_t size){
+    if(transport){
+        // already encoded in the transport's buffer
+        transport->commit(size);
+        return;
+    }
+    sendSocket->Send(data, size);
+}
+
+//--------------------------------------------------------------
+void ofxOscSenderReceiver::cancelPacket(){
+    if(transport) transport->cancel();
+}
+
+//--------------------------------------------------------------
+void ofxOscSenderReceiver::sendEncoded(const char *data, size_t size){
+    if(!canSend()){
+        ofLogError("ofxOscSender") << "trying to send with empty socket";
+        return;
+    }
+    if(transport){
+        std::memcpy(transport->reserve(size), data, size);
+        transport->commit(size);
+        return;
+    }
+    sendSocket->Send(data, size);
 }
 
 //--------------------------------------------------------------
 void ofxOscSenderReceiver::sendBundle(const ofxOscBundle &bundle, uint64_t timetag){
-    if(!sendSocket){
+    if(!canSend()){
         ofLogError("ofxOscSender") << "trying to send with empty socket";
         return;
     }
     
-    // setting this much larger as it gets trimmed down to the size its using before being sent.
-    // TODO: much better if we could make this dynamic? Maybe have ofxOscBundle return its size?
-    static const int OUTPUT_BUFFER_SIZE = 327680;
-    char buffer[OUTPUT_BUFFER_SIZE];
-    osc::OutboundPacketStream p(buffer, OUTPUT_BUFFER_SIZE);
+    // the bundle is sent nested inside the timetagged one
+    size_t size = BUNDLE_HEADER_SIZE + BUNDLE_ELEMENT_SIZE + getEncodedSize(bundle);
+    char *buffer = getSendBuffer(size);
+    osc::OutboundPacketStream p(buffer, size);
 
     // serialise the bundle and send
-    p << osc::BundleInitiator(timetag);
-    appendBundle(bundle, p);
-    p << osc::EndBundle;
-    sendSocket->Send(p.Data(), p.Size());
+    try{
+        p << osc::BundleInitiator(timetag);
+        appendBundle(bundle, p);
+        p << osc::EndBundle;
+    }
+    catch(osc::Exception &e){
+        ofLogError("ofxOscSender") << "sendBundle(): couldn't encode bundle: " << e.what();
+        cancelPacket();
+        return;
+    }
+    sendPacket(p.Data(), p.Size());
 }
 
 //--------------------------------------------------------------
 void ofxOscSenderReceiver::sendMessage(const ofxOscMessage &message, bool wrapInBundle, uint64_t timetag){
-    if(!sendSocket){
+    if(!canSend()){
         ofLogError("ofxOscSender") << "trying to send with empty socket";
         return;
     }
     
-    // setting this much larger as it gets trimmed down to the size its using before being sent.
-    // TODO: much better if we could make this dynamic? Maybe have ofxOscMessage return its size?
-    static const int OUTPUT_BUFFER_SIZE = 327680;
-    char buffer[OUTPUT_BUFFER_SIZE];
-    osc::OutboundPacketStream p(buffer, OUTPUT_BUFFER_SIZE);
+    size_t size = getEncodedSize(message);
+    if(wrapInBundle) {
+        size += BUNDLE_HEADER_SIZE + BUNDLE_ELEMENT_SIZE;
+    }
+    char *buffer = getSendBuffer(size);
+    osc::OutboundPacketStream p(buffer, size);
 
     // serialise the message and send
-    if(wrapInBundle) {
-        p << osc::BundleInitiator(timetag);
+    try{
+        if(wrapInBundle) {
+            p << osc::BundleInitiator(timetag);
+        }
+        appendMessage(message, p);
+        if(wrapInBundle) {
+            p << osc::EndBundle;
+        }
     }
-    appendMessage(message, p);
-    if(wrapInBundle) {
-        p << osc::EndBundle;
+    catch(osc::Exception &e){
+        ofLogError("ofxOscSender") << "sendMessage(): couldn't encode " << message.getAddress() << ": " << e.what();
+        cancelPacket();
+        return;
     }
-    sendSocket->Send(p.Data(), p.Size());
+    sendPacket(p.Data(), p.Size());
 }
 
 //--------------------------------------------------------------
@@ -237,6 +367,56 @@ const ofxOscSenderReceiverSettings &ofxOscSenderReceiver::getSettings() const {
     return settings;
 }
 
+//--------------------------------------------------------------
+size_t ofxOscSenderReceiver::getEncodedSize(const ofxOscMessage &message){
+    // address and type tag string (comma, one tag per argument, terminator), both zero padded
+    size_t size = paddedLength(message.getAddress().size() + 1) + paddedLength(message.getNumArgs() + 2);
+    for(size_t i = 0; i < message.getNumArgs(); ++i){
+        switch(message.getArgType(i)){
+            case OFXOSC_TYPE_INT32:
+            case OFXOSC_TYPE_FLOAT:
+            case OFXOSC_TYPE_MIDI_MESSAGE:
+            case OFXOSC_TYPE_RGBA_COLOR:
+                size += 4;
+                break;
+            case OFXOSC_TYPE_INT64:
+            case OFXOSC_TYPE_DOUBLE:
+            case OFXOSC_TYPE_TIMETAG:
+                size += 8;
+                break;
+            case OFXOSC_TYPE_STRING:
+            case OFXOSC_TYPE_SYMBOL:
+                size += paddedLength(message.getArgAsString(i).size() + 1);
+                break;
+            case OFXOSC_TYPE_CHAR:
+                // '[' and ']' are array delimiters, type tag only
+                if(message.getArgAsChar(i) != '[' && message.getArgAsChar(i) != ']'){
+                    size += 4;
+                }
+                break;
+            case OFXOSC_TYPE_BLOB:
+                size += 4 + paddedLength(message.getArgAsBlob(i).size());
+                break;
+            default:
+                // true, false, nil and infinitum are type tag only
+                break;
+        }
+    }
+    return size;
+}
+
+//--------------------------------------------------------------
+size_t ofxOscSenderReceiver::getEncodedSize(const ofxOscBundle &bundle){
+    size_t size = BUNDLE_HEADER_SIZE;
+    for(int i = 0; i < bundle.getBundleCount(); i++){
+        size += BUNDLE_ELEMENT_SIZE + getEncodedSize(bundle.getBundleAt(i));
+    }
+    for(int i = 0; i < bundle.getMessageCount(); i++){
+        size += BUNDLE_ELEMENT_SIZE + getEncodedSize(bundle.getMessageAt(i));
+    }
+    return size;
+}
+
 // PRIVATE
 //--------------------------------------------------------------
 void ofxOscSenderReceiver::appendBundle(const ofxOscBundle &bundle, osc::OutboundPacketStream &p){
@@ -359,17 +539,45 @@ void ofxOscSenderReceiver::appendParameter(ofxOscMessage &msg, const ofAbstractP
 
 //--------------------------------------------------------------
 void ofxOscSenderReceiver::stop() {
-    listenSocket.reset();
+    if(listenSocket){
+        // safe from another thread. Run() clears the break request when it starts,
+        // so keep asking until the thread is really out in case it hadn't yet
+        do{
+            listenSocket->AsynchronousBreak();
+        }while(listenThreadDone.valid() && listenThreadDone.wait_for(std::chrono::milliseconds(100)) == std::future_status::timeout);
+        if(listenThread.joinable()){
+            listenThread.join();
+        }
+        sendSocket = nullptr;
+        listenSocket.reset();
+    }
+    if(transport) transport->stopReceiving();
 }
 
 //--------------------------------------------------------------
 bool ofxOscSenderReceiver::isListening() const{
+    if(transport) return transport->isReceiving();
     return listenSocket != nullptr;
 }
 
 //--------------------------------------------------------------
 bool ofxOscSenderReceiver::hasWaitingMessages() const{
-    return !messagesChannel.empty();
+    return !messages.empty();
+}
+
+//--------------------------------------------------------------
+uint64_t ofxOscSenderReceiver::getNumDroppedMessages() const{
+    return messages.getNumOverflows();
+}
+
+//--------------------------------------------------------------
+bool ofxOscSenderReceiver::hasWaitingReplies() const{
+    return !replies.empty();
+}
+
+//--------------------------------------------------------------
+uint64_t ofxOscSenderReceiver::getNumDroppedReplies() const{
+    return replies.getNumOverflows();
 }
 
 //--------------------------------------------------------------
@@ -379,13 +587,13 @@ bool ofxOscSenderReceiver::getNextMessage(ofxOscMessage *message){
 
 //--------------------------------------------------------------
 bool ofxOscSenderReceiver::getNextMessage(ofxOscMessage &message){
-    return messagesChannel.tryReceive(message);
+    return messages.pop(message);
 }
 
 //--------------------------------------------------------------
 bool ofxOscSenderReceiver::getParameter(ofAbstractParameter &parameter){
     ofxOscMessage msg;
-    while(messagesChannel.tryReceive(msg)){
+    while(messages.pop(msg)){
         ofAbstractParameter * p = &parameter;
         std::vector<std::string> address = ofSplitString(msg.getAddress(),"/", true);
         for(unsigned int i = 0; i < address.size(); i++){
@@ -436,8 +644,29 @@ bool ofxOscSenderReceiver::getParameter(ofAbstractParameter &parameter){
 }
 
 // PROTECTED
+//--------------------------------------------------------------
+void ofxOscSenderReceiver::ProcessPacket(const char *data, int size, const osc::IpEndpointName &remoteEndpoint){
+    // once per packet, a bundle of replies wakes the reader once
+    osc::OscPacketListener::ProcessPacket(data, size, remoteEndpoint);
+    if(wakeup != nullptr) wakeup->wake();
+}
+
 //--------------------------------------------------------------
 void ofxOscSenderReceiver::ProcessMessage(const osc::ReceivedMessage &m, const osc::IpEndpointName &remoteEndpoint){
+    // fast path, known replies go straight from the packet to a queue slot
+    if(settings.decodeReplies){
+        static const int maxDecodedEvents = 64;
+        ofxSCReplyEvent decoded[maxDecodedEvents];
+        int numDecoded = ofxSCDecodeReply(m, decoded, maxDecodedEvents);
+        for(int i = 0; i < numDecoded; i++){
+            ofxSCReceivedReply reply;
+            reply.decoded = true;
+            reply.event = decoded[i];
+            replies.push(reply, settings.overflowPolicy);
+        }
+        if(numDecoded >= 0) return;
+    }
+    
     // convert the message to an ofxOscMessage
     ofxOscMessage msg;
 
@@ -505,8 +734,14 @@ void ofxOscSenderReceiver::ProcessMessage(const osc::ReceivedMessage &m, const o
         }
     }
 
-    // send msg to main thread
-    messagesChannel.send(std::move(msg));
+    // send msg to main thread, behind the decoded replies that came before it
+    if(settings.decodeReplies){
+        ofxSCReceivedReply reply;
+        reply.message = std::move(msg);
+        replies.push(reply, settings.overflowPolicy);
+    }else{
+        messages.push(msg, settings.overflowPolicy);
+    }
 }
 
 
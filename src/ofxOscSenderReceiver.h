@@ -17,10 +17,17 @@
 #include "OscPacketListener.h"
 #include "UdpSocket.h"
 
+#include <future>
+
 #include "ofxOscBundle.h"
 #include "ofParameter.h"
 
-#include "ofThreadChannel.h"
+#include "ofxSCRingBuffer.h"
+#include "ofxSCReplyEvent.h"
+#include "ofxSCTransport.h"
+#include "ofxSCUdpSocket.h"
+#include "ofxSCTcpSocket.h"
+#include "ofxSCWakeup.h"
 
 /// \struct ofxOscSenderSettings
 /// \brief OSC message sender settings
@@ -31,6 +38,10 @@ struct ofxOscSenderReceiverSettings {
     int inPort = 0;                 ///< receiving port
     bool reuse = true;              ///< should the port be reused by other receivers?
     bool start = true;              ///< start listening after setup?
+    ofxSCOverflowPolicy overflowPolicy = OFXSC_DROP_OLDEST; ///< what to drop when received messages aren't collected fast enough
+    bool decodeReplies = false;     ///< decode fixed shape scsynth replies into ofxSCReplyEvent instead of ofxOscMessage, everything received then comes from getNextReplies()
+    bool nativeSocket = false;      ///< use ofxSCUdpSocket instead of oscpack's sockets, needed for beginBatch(). Ignored on Windows
+    bool tcp = false;               ///< connect to host:outPort over TCP (scsynth -t) with ofxSCTcpSocket, inPort is unused. Not on Windows
 };
 
 /// \class ofxOscSenderReceiver
@@ -53,6 +64,20 @@ public:
     /// \returns true on success
     bool setup(const ofxOscSenderReceiverSettings &settings);
 
+    /// send and receive through transport instead of a socket made from the
+    /// settings, e.g. an ofxSCLoopbackTransport. Takes ownership
+    /// \return false if transport isn't open or can't receive
+    bool setTransport(std::unique_ptr<ofxSCTransport> transport);
+
+    /// \return the transport in use, nullptr with oscpack's sockets
+    ofxSCTransport *getTransport() const {return transport.get();};
+
+    /// \return true if every packet has to fit in a datagram, false over TCP or in process
+    bool isPacketSizeLimited() const;
+
+    /// \return true if any thread may send at any time, with the native sockets
+    bool isThreadSafe() const;
+
     /// clear the sender, does not clear host or port values
     void clear();
 
@@ -63,9 +88,31 @@ public:
     /// send the given bundle
     void sendBundle(const ofxOscBundle &bundle, uint64_t timetag = 1);
 
+    /// send a packet that is already OSC encoded, as is
+    void sendEncoded(const char *data, size_t size);
+
+    /// queue everything sent until the matching endBatch() and send it in as few
+    /// system calls as possible. Batches nest. Only has an effect with a
+    /// transport (ofxOscSenderReceiverSettings::nativeSocket, tcp or setTransport()).
+    /// Other threads may keep sending, what they send meanwhile joins the batch
+    void beginBatch();
+    void endBatch();
+
+    /// \return send counters, only kept with a transport
+    ofxSCTransmitStats getTransmitStats() const;
+
+    /// \return receive counters, only kept with a transport
+    ofxSCReceiveStats getReceiveStats() const;
+
     /// create & send a message with data from an ofParameter
     void sendParameter(const ofAbstractParameter &parameter);
 
+    /// \return number of bytes message takes once encoded as OSC
+    static size_t getEncodedSize(const ofxOscMessage &message);
+
+    /// \return number of bytes bundle takes once encoded as OSC, nested bundles included
+    static size_t getEncodedSize(const ofxOscBundle &bundle);
+
     /// \return current host name/ip
     std::string getHost() const;
 
@@ -97,6 +144,40 @@ public:
     bool getNextMessage(ofxOscMessage& msg);
     OF_DEPRECATED_MSG("Pass a reference instead of a pointer", bool getNextMessage(ofxOscMessage *msg));
     
+    /// call fn(ofxOscMessage&) for up to max waiting messages, oldest first
+    /// \return number of messages handled
+    template<typename F>
+    size_t getNextMessages(F &&fn, size_t max = std::numeric_limits<size_t>::max()){
+        return messages.drain(fn, max);
+    }
+    
+    /// \return number of received messages dropped because the queue was full
+    uint64_t getNumDroppedMessages() const;
+    
+    /// \return true if there are replies waiting, see ofxOscSenderReceiverSettings::decodeReplies
+    bool hasWaitingReplies() const;
+    
+    /// with decodeReplies, call onEvent(ofxSCReplyEvent&) for decoded replies and
+    /// onMessage(ofxOscMessage&) for the others, up to max in all, in the order they arrived
+    /// \return number of replies handled
+    template<typename E, typename M>
+    size_t getNextReplies(E &&onEvent, M &&onMessage, size_t max = std::numeric_limits<size_t>::max()){
+        return replies.drain([&](ofxSCReceivedReply &reply){
+            if(reply.decoded){
+                onEvent(reply.event);
+            }else{
+                onMessage(reply.message);
+            }
+        }, max);
+    }
+    
+    /// \return number of replies dropped because the queue was full
+    uint64_t getNumDroppedReplies() const;
+    
+    /// wake whoever sleeps on wakeup once a received packet is queued. Set it
+    /// before setup() or setTransport(), not owned
+    void setWakeup(ofxSCWakeup *wakeup){this->wakeup = wakeup;};
+    
     /// try to get waiting message an ofParameter
     /// \return true if message was handled by the given parameter
     bool getParameter(ofAbstractParameter &parameter);
@@ -110,11 +191,20 @@ public:
     
 protected:
 
+    /// queue everything in the packet, then wake the reader
+    virtual void ProcessPacket(const char *data, int size, const osc::IpEndpointName &remoteEndpoint);
     /// process an incoming osc message and add it to the queue
     virtual void ProcessMessage(const osc::ReceivedMessage &m, const osc::IpEndpointName &remoteEndpoint);
 
 private:
 
+    bool canSend() const;
+    /// \return where to encode a packet of size bytes, passed back to sendPacket()
+    char *getSendBuffer(size_t size);
+    void sendPacket(const char *data, size_t size);
+    /// give up a buffer from getSendBuffer() that couldn't be encoded
+    void cancelPacket();
+
     // helper methods for constructing messages
     void appendBundle(const ofxOscBundle &bundle, osc::OutboundPacketStream &p);
     void appendMessage(const ofxOscMessage &message, osc::OutboundPacketStream &p);
@@ -122,14 +212,19 @@ private:
     void appendParameter(ofxOscMessage &msg, const ofAbstractParameter &parameter, const std::string &address);
 
     ofxOscSenderReceiverSettings settings; ///< current settings
-    std::unique_ptr<osc::UdpTransmitSocket> sendSocket; ///< sender socket
+    osc::UdpTransmitSocket *sendSocket = nullptr; ///< sender socket, listenSocket connected to the host, not owned
 
     /// socket to listen on, unique for each port
     /// shared between objects if allowReuse is true
-    std::unique_ptr<osc::UdpListeningReceiveSocket, std::function<void(osc::UdpListeningReceiveSocket*)>> listenSocket;
-
-    std::thread listenThread; ///< listener thread
-    ofThreadChannel<ofxOscMessage> messagesChannel; ///< message passing thread channel
+    std::unique_ptr<osc::UdpListeningReceiveSocket> listenSocket;
+
+    std::thread listenThread; ///< listener thread, joined in stop()
+    std::future<void> listenThreadDone; ///< ready once the listener thread is done
+    std::unique_ptr<ofxSCTransport> transport; ///< sends and receives instead of the oscpack sockets when set
+    ofxSCWakeup *wakeup = nullptr; ///< woken after each received packet
+    // only one of these is filled, and allocated, depending on decodeReplies
+    ofxSCRingBuffer<ofxOscMessage> messages{8192}; ///< received messages, filled by the listener thread
+    ofxSCRingBuffer<ofxSCReceivedReply> replies{8192}; ///< everything received with decodeReplies, filled by the listener thread
 };
 
 #endif
@@ -20,9 +20,13 @@ ofxSCBuffer::ofxSCBuffer(int frames, int channels, ofxSCServer *server)
 	this->frames     = frames;
 	this->channels   = channels;
 	
+	std::lock_guard<std::mutex> lock(server->resourcesMutex);
 	index = server->allocatorBuffer->alloc(1);
 	
-	server->buffers[index] = this;
+	if (index >= 0)
+		server->buffers.set(index, this);
+	else
+		ofLogError("ofxSCBuffer") << "no buffer numbers left";
 	ready = false;
 }
 
@@ -63,12 +67,9 @@ void ofxSCBuffer::readChannel(std::string path, std::vector<int> channelsToRead)
     server->sendMsg(m);
 }
 
-void ofxSCBuffer::query()
+std::shared_future<ofxSCReply> ofxSCBuffer::query(ofxSCReplyCallback callback)
 {
-	ofxOscMessage m;	
-	m.setAddress("/b_query");
-	m.addIntArg(index);
-	server->sendMsg(m);
+	return server->queryBuffer(index, callback);
 }
 
 void ofxSCBuffer::alloc()
@@ -83,11 +84,14 @@ void ofxSCBuffer::alloc()
 
 void ofxSCBuffer::free()
 {
+	if (index < 0) return;
+	
 	ofxOscMessage m;	
 	m.setAddress("/b_free");
 	m.addIntArg(index);
 	server->sendMsg(m);
     
-    server->buffers[index] = NULL;
+    std::lock_guard<std::mutex> lock(server->resourcesMutex);
+    server->buffers.erase(index);
 	server->allocatorBuffer->free(index);
 }
@@ -24,7 +24,8 @@ public:
 	
 	void read(std::string path);
     void readChannel(std::string path, std::vector<int> channelsToRead);
-	void query();
+	/// /b_query, frames, channels and sampleRate are updated before the reply completes
+	std::shared_future<ofxSCReply> query(ofxSCReplyCallback callback = nullptr);
 	void alloc();
 	
 //	void write(...);
@@ -23,17 +23,20 @@ ofxSCBus::ofxSCBus(int rate, int channels, ofxSCServer *server)
 	this->channels = channels;
 	this->server = server;	
 	
+	std::lock_guard<std::mutex> lock(server->resourcesMutex);
 	if (this->rate == RATE_CONTROL)
 	{
 		this->index = server->allocatorBusControl->alloc(this->channels);
-        server->controlBusses[index] = this;
+        if(index >= 0) server->controlBusses.set(index, this);
         readValues.resize(this->channels, 0);
 	}
 	else
 	{
 		this->index = server->allocatorBusAudio->alloc(this->channels);
-        server->audioBusses[index] = this;
+        if(index >= 0) server->audioBusses.set(index, this);
 	}
+	if (index < 0)
+		ofLogError("ofxSCBus") << "no room for " << this->channels << " consecutive " << (this->rate == RATE_CONTROL ? "control" : "audio") << " busses";
 }
 
 ofxSCBus::~ofxSCBus(){
@@ -87,10 +90,18 @@ ofxSCBus& ofxSCBus::operator=(ofxSCBus&& other) noexcept {
 
 void ofxSCBus::set(float value)
 {
+    if(server == nullptr || index < 0){
+        ofLogWarning("ofxSCBus") << "set(): bus isn't allocated";
+        return;
+    }
+    if(server->getCoalescing()){
+        server->coalesceBus(index, value);
+        return;
+    }
     ofxOscMessage m;
     m.setAddress("/c_set");
     m.addIntArg(index);
-    m.addIntArg(value);
+    m.addFloatArg(value);
     server->sendMsg(m);
 }
 
@@ -98,21 +109,19 @@ void ofxSCBus::free()
 {
 	// nothing is actually allocated server-side,
 	// so all we need to do here is reflect the availability of this address
+    if (server == nullptr || index < 0) return;
+    std::lock_guard<std::mutex> lock(server->resourcesMutex);
     if (this->rate == RATE_CONTROL){
 		server->allocatorBusControl->free(this->index);
-        server->controlBusses[index] = NULL;
+        server->controlBusses.erase(index);
     }else{
         server->allocatorBusAudio->free(this->index);
-        server->audioBusses[index] = NULL;
+        server->audioBusses.erase(index);
     }
+    index = -1;
 }
 
-void ofxSCBus::requestValues()
+std::shared_future<ofxSCReply> ofxSCBus::requestValues(ofxSCReplyCallback callback)
 {
-    ofxOscMessage m;
-    m.setAddress("/c_get");
-    for(int i = 0; i < channels; i++){
-        m.addIntArg(index + i);
-    }
-    server->sendMsg(m);
+    return server->getControlBusses(index, channels, callback);
 }
@@ -38,7 +38,8 @@ public:
 	
     void set(float value);
 	void free();
-    void requestValues();
+    /// /c_get for every channel, readValues is updated before the reply completes
+    std::shared_future<ofxSCReply> requestValues(ofxSCReplyCallback callback = nullptr);
 	
 	static int id_base;
 	
@@ -15,7 +15,7 @@
 
 void ofxSCGroup::create(int position, int groupID, bool parallel)
 {
-	nodeID = ofxSCNode::id_base++;
+	setNodeID(getServer()->getNodeIDAllocator().alloc());
 	
 	ofxOscMessage m;
 	
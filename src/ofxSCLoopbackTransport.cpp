@@ -0,0 +1,91 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCLoopbackTransport.h"
+
+// replies look like they come from the local scsynth port
+static const unsigned long LOOPBACK_ADDRESS = 0x7F000001;
+static const int LOOPBACK_PORT = 57110;
+
+//--------------------------------------------------------------
+ofxSCLoopbackTransport::ofxSCLoopbackTransport(SendFunction sendFunction) : sendFunction(sendFunction), open(true), receiving(false), sentPackets(0), sentBytes(0), receivedPackets(0), receivedBytes(0)
+{
+}
+
+//--------------------------------------------------------------
+void ofxSCLoopbackTransport::setSendFunction(SendFunction _sendFunction)
+{
+    sendFunction = _sendFunction;
+}
+
+//--------------------------------------------------------------
+void ofxSCLoopbackTransport::receive(const char *data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(callbackMutex);
+    if(!receiving) return;
+    receivedPackets.fetch_add(1, std::memory_order_relaxed);
+    receivedBytes.fetch_add(size, std::memory_order_relaxed);
+    callback(data, size, osc::IpEndpointName(LOOPBACK_ADDRESS, LOOPBACK_PORT));
+}
+
+//--------------------------------------------------------------
+void ofxSCLoopbackTransport::close()
+{
+    stopReceiving();
+    open = false;
+}
+
+//--------------------------------------------------------------
+void ofxSCLoopbackTransport::send(const char *data, size_t size)
+{
+    if(!open || !sendFunction) return;
+    sentPackets.fetch_add(1, std::memory_order_relaxed);
+    sentBytes.fetch_add(size, std::memory_order_relaxed);
+    sendFunction(data, size);
+}
+
+//--------------------------------------------------------------
+bool ofxSCLoopbackTransport::startReceiving(PacketCallback _callback)
+{
+    if(!open) return false;
+    std::lock_guard<std::mutex> lock(callbackMutex);
+    callback = _callback;
+    receiving = true;
+    return true;
+}
+
+//--------------------------------------------------------------
+void ofxSCLoopbackTransport::stopReceiving()
+{
+    // waits for a receive() in progress
+    std::lock_guard<std::mutex> lock(callbackMutex);
+    receiving = false;
+}
+
+//--------------------------------------------------------------
+ofxSCTransmitStats ofxSCLoopbackTransport::getStats() const
+{
+    ofxSCTransmitStats s;
+    s.sendCalls = s.datagrams = sentPackets.load(std::memory_order_relaxed);
+    s.bytes = sentBytes.load(std::memory_order_relaxed);
+    return s;
+}
+
+//--------------------------------------------------------------
+ofxSCReceiveStats ofxSCLoopbackTransport::getReceiveStats() const
+{
+    ofxSCReceiveStats s;
+    s.receiveCalls = s.datagrams = receivedPackets.load(std::memory_order_relaxed);
+    s.bytes = receivedBytes.load(std::memory_order_relaxed);
+    return s;
+}
@@ -0,0 +1,73 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include "ofxSCTransport.h"
+
+/// Transport for a server in the same process, packets are exchanged through
+/// function calls instead of a socket: an embedded libscsynth, a mock server,
+/// or a benchmark that wants serialization and dispatch without the kernel.
+///
+/// Every packet the client sends is passed to the send function. Replies are
+/// handed back with receive(), from any thread. With libscsynth:
+///
+///     auto transport = new ofxSCLoopbackTransport([world](const char *data, size_t size){
+///         World_SendPacket(world, (int)size, (char*)data, replyFunc);
+///     });
+///     // replyFunc(ReplyAddress*, char *data, int size) calls transport->receive(data, size)
+///     server.setTransport(std::unique_ptr<ofxSCTransport>(transport));
+class ofxSCLoopbackTransport : public ofxSCTransport
+{
+public:
+    typedef std::function<void(const char *data, size_t size)> SendFunction;
+
+    explicit ofxSCLoopbackTransport(SendFunction sendFunction = nullptr);
+
+    /// called with every packet sent, the data is only valid during the call
+    void setSendFunction(SendFunction sendFunction);
+
+    /// deliver a packet to the client as if it had arrived from the server.
+    /// Dropped if nothing is receiving
+    void receive(const char *data, size_t size);
+
+    void close() override;
+    bool isOpen() const override {return open;};
+
+    void send(const char *data, size_t size) override;
+
+    bool startReceiving(PacketCallback callback) override;
+    void stopReceiving() override;
+    bool isReceiving() const override {return receiving;};
+
+    /// packets are handed over whole, any size goes
+    bool isPacketSizeLimited() const override {return false;};
+
+    ofxSCTransmitStats getStats() const override;
+    ofxSCReceiveStats getReceiveStats() const override;
+
+private:
+    SendFunction sendFunction;
+    PacketCallback callback;
+    std::mutex callbackMutex;   ///< receive() against stopReceiving()
+    std::atomic<bool> open;
+    std::atomic<bool> receiving;
+
+    std::atomic<uint64_t> sentPackets;
+    std::atomic<uint64_t> sentBytes;
+    std::atomic<uint64_t> receivedPackets;
+    std::atomic<uint64_t> receivedBytes;
+};
@@ -0,0 +1,949 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCMockServer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "ofLog.h"
+#include "ofxSCLoopbackTransport.h"
+#include "ofxSCReplyEvent.h"
+
+// big enough for any reply, /g_queryTree of a large tree included
+static const size_t REPLY_BUFFER_SIZE = 1 << 20;
+// UDP clients are keyed by address and port, loopback clients count up from 1
+static const uint64_t UDP_CLIENT = 1ull << 63;
+
+typedef osc::ReceivedMessage::const_iterator ArgIterator;
+
+// scsynth accepts any numeric type where it wants a number
+static bool readInt(ArgIterator &arg, const ArgIterator &end, int &value)
+{
+    if(arg == end) return false;
+    if(arg->IsInt32()) value = arg->AsInt32Unchecked();
+    else if(arg->IsFloat()) value = (int)arg->AsFloatUnchecked();
+    else if(arg->IsDouble()) value = (int)arg->AsDoubleUnchecked();
+    else if(arg->IsInt64()) value = (int)arg->AsInt64Unchecked();
+    else return false;
+    ++arg;
+    return true;
+}
+
+static bool readFloat(ArgIterator &arg, const ArgIterator &end, float &value)
+{
+    if(arg == end) return false;
+    if(arg->IsFloat()) value = arg->AsFloatUnchecked();
+    else if(arg->IsInt32()) value = (float)arg->AsInt32Unchecked();
+    else if(arg->IsDouble()) value = (float)arg->AsDoubleUnchecked();
+    else if(arg->IsInt64()) value = (float)arg->AsInt64Unchecked();
+    else return false;
+    ++arg;
+    return true;
+}
+
+static bool readString(ArgIterator &arg, const ArgIterator &end, std::string &value)
+{
+    if(arg == end) return false;
+    if(arg->IsString()) value = arg->AsStringUnchecked();
+    else if(arg->IsSymbol()) value = arg->AsSymbolUnchecked();
+    else return false;
+    ++arg;
+    return true;
+}
+
+// controls are set by name or by index, indices are kept as their decimal string
+static bool readControlName(ArgIterator &arg, const ArgIterator &end, std::string &value)
+{
+    int index;
+    if(readString(arg, end, value)) return true;
+    if(!readInt(arg, end, index)) return false;
+    value = std::to_string(index);
+    return true;
+}
+
+// a command that needs a number but got something else is skipped like scsynth does
+static void skipArg(ArgIterator &arg, const ArgIterator &end)
+{
+    if(arg != end) ++arg;
+}
+
+//--------------------------------------------------------------
+// Loopback transport that unregisters itself from the mock when it goes away
+class ofxSCMockTransport : public ofxSCLoopbackTransport
+{
+public:
+    ofxSCMockTransport(ofxSCMockServer *mock, uint64_t clientKey) : mock(mock), clientKey(clientKey)
+    {
+        setSendFunction([this](const char *data, size_t size){
+            this->mock->handlePacket(data, size, this->clientKey, [this](const char *reply, size_t replySize){
+                receive(reply, replySize);
+            });
+        });
+    }
+    ~ofxSCMockTransport()
+    {
+        stopReceiving();
+        mock->removeClient(clientKey);
+    }
+
+private:
+    ofxSCMockServer *mock;
+    uint64_t clientKey;
+};
+
+//--------------------------------------------------------------
+ofxSCMockServer::ofxSCMockServer(const ofxSCMockServerSettings &settings) : settings(settings), nextLoopbackClient(1), random(settings.seed), replyBuffer(REPLY_BUFFER_SIZE), nextReplyOrder(0), schedulerRunning(false)
+{
+    reset();
+}
+
+//--------------------------------------------------------------
+ofxSCMockServer::~ofxSCMockServer()
+{
+    stop();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        schedulerRunning = false;
+    }
+    pendingChanged.notify_all();
+    if(schedulerThread.joinable()) schedulerThread.join();
+}
+
+//--------------------------------------------------------------
+bool ofxSCMockServer::start()
+{
+#ifdef OFXSC_HAS_NATIVE_SOCKETS
+    stop();
+    std::unique_ptr<ofxSCUdpSocket> udp(new ofxSCUdpSocket());
+    if(!udp->open("", 0, settings.port, true)){
+        return false;
+    }
+    ofxSCUdpSocket *s = udp.get();
+    bool started = udp->startReceiving([this, s](const char *data, size_t size, const osc::IpEndpointName &from){
+        uint64_t clientKey = UDP_CLIENT | ((uint64_t)from.address << 16) | (uint16_t)from.port;
+        handlePacket(data, size, clientKey, [s, from](const char *reply, size_t replySize){
+            s->sendTo(reply, replySize, from);
+        });
+    });
+    if(!started) return false;
+    socket = std::move(udp);
+    return true;
+#else
+    ofLogError("ofxSCMockServer") << "start(): no UDP on this platform, use createTransport()";
+    return false;
+#endif
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::stop()
+{
+#ifdef OFXSC_HAS_NATIVE_SOCKETS
+    if(!socket) return;
+    socket->stopReceiving();
+
+    // nothing may reach the socket once it is gone
+    std::lock_guard<std::recursive_mutex> deliveryLock(deliveryMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto isUdp = [](const PendingReply &r){ return (r.client & UDP_CLIENT) != 0; };
+        pending.erase(std::remove_if(pending.begin(), pending.end(), isUdp), pending.end());
+        std::make_heap(pending.begin(), pending.end(), std::greater<PendingReply>());
+        outbox.erase(std::remove_if(outbox.begin(), outbox.end(), isUdp), outbox.end());
+        for(auto it = notifiedClients.begin(); it != notifiedClients.end();){
+            if(it->first & UDP_CLIENT) it = notifiedClients.erase(it);
+            else ++it;
+        }
+    }
+    socket.reset();
+#endif
+}
+
+//--------------------------------------------------------------
+bool ofxSCMockServer::isRunning() const
+{
+#ifdef OFXSC_HAS_NATIVE_SOCKETS
+    return socket && socket->isReceiving();
+#else
+    return false;
+#endif
+}
+
+//--------------------------------------------------------------
+std::unique_ptr<ofxSCTransport> ofxSCMockServer::createTransport()
+{
+    uint64_t clientKey;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        clientKey = nextLoopbackClient++;
+    }
+    return std::unique_ptr<ofxSCTransport>(new ofxSCMockTransport(this, clientKey));
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::removeClient(uint64_t clientKey)
+{
+    std::lock_guard<std::recursive_mutex> deliveryLock(deliveryMutex);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto isClient = [clientKey](const PendingReply &r){ return r.client == clientKey; };
+    pending.erase(std::remove_if(pending.begin(), pending.end(), isClient), pending.end());
+    std::make_heap(pending.begin(), pending.end(), std::greater<PendingReply>());
+    outbox.erase(std::remove_if(outbox.begin(), outbox.end(), isClient), outbox.end());
+    notifiedClients.erase(clientKey);
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::handlePacket(const char *data, size_t size, uint64_t clientKey, ReplyFunction reply)
+{
+    std::lock_guard<std::recursive_mutex> deliveryLock(deliveryMutex);
+    std::vector<PendingReply> replies;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.packetsReceived++;
+        if(settings.requestLoss > 0 && std::uniform_real_distribution<float>(0, 1)(random) < settings.requestLoss){
+            stats.packetsDropped++;
+            return;
+        }
+        try{
+            handleElement(data, size, clientKey, reply);
+        }
+        catch(osc::Exception &e){
+            stats.packetsDropped++;
+            ofLogWarning("ofxSCMockServer") << "bad packet: " << e.what();
+        }
+        replies.swap(outbox);
+    }
+    // mutex is released first, the client may well send again from its callback
+    deliver(replies);
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::handleElement(const char *data, size_t size, uint64_t client, const ReplyFunction &reply)
+{
+    osc::ReceivedPacket packet(data, (osc::osc_bundle_element_size_t)size);
+    if(packet.IsBundle()){
+        // timetags are ignored, bundles run as soon as they arrive
+        osc::ReceivedBundle bundle(packet);
+        for(auto element = bundle.ElementsBegin(); element != bundle.ElementsEnd(); ++element){
+            handleElement(element->Contents(), element->Size(), client, reply);
+        }
+    }
+    else{
+        handleMessage(osc::ReceivedMessage(packet), client, reply);
+    }
+}
+
+//--------------------------------------------------------------
+// the commands handleMessage() knows, to tell them from a foreign address
+// with the same hash
+static const char *mockCommands[] = {
+    "/status", "/sync", "/notify", "/s_new", "/g_new", "/p_new", "/n_free", "/n_set", "/n_run",
+    "/n_query", "/g_freeAll", "/g_deepFree", "/g_queryTree", "/c_set", "/c_setn", "/c_fill",
+    "/c_get", "/b_alloc", "/b_allocRead", "/b_free", "/b_query", "/b_set", "/b_setn", "/b_fill",
+    "/b_zero", "/d_recv", "/d_load", "/d_loadDir", "/quit"
+};
+
+//--------------------------------------------------------------
+static uint32_t commandHash(const char *address)
+{
+    static const std::unordered_map<uint32_t, const char*> known = []{
+        std::unordered_map<uint32_t, const char*> map;
+        for(const char *command : mockCommands) map[ofxSCAddressHash(command)] = command;
+        return map;
+    }();
+    uint32_t hash = ofxSCAddressHash(address);
+    auto it = known.find(hash);
+    // no command hashes to 0, so a collision ends up in "Command not found"
+    if(it == known.end() || std::strcmp(address, it->second) != 0) return 0;
+    return hash;
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::handleMessage(const osc::ReceivedMessage &m, uint64_t client, const ReplyFunction &reply)
+{
+    stats.messagesHandled++;
+
+    const char *address = m.AddressPattern();
+    ArgIterator arg = m.ArgumentsBegin();
+    ArgIterator end = m.ArgumentsEnd();
+    osc::OutboundPacketStream p(replyBuffer.data(), replyBuffer.size());
+
+    switch(commandHash(address)){
+        case ofxSCAddressHash("/status"):
+        {
+            int numSynths = 0;
+            int numGroups = 0;
+            for(auto &it : nodes){
+                if(it.second.isGroup) numGroups++;
+                else numSynths++;
+            }
+            p << osc::BeginMessage("/status.reply") << 1 << numSynths << numSynths << numGroups << numSynthDefs
+              << 0.5f << 1.0f << settings.sampleRate << settings.sampleRate << osc::EndMessage;
+            sendReply(p, client, reply);
+            break;
+        }
+
+        case ofxSCAddressHash("/sync"):
+        {
+            int syncID = 0;
+            readInt(arg, end, syncID);
+            p << osc::BeginMessage("/synced") << syncID << osc::EndMessage;
+            sendReply(p, client, reply);
+            break;
+        }
+
+        case ofxSCAddressHash("/notify"):
+        {
+            int flag = 0;
+            readInt(arg, end, flag);
+            if(flag) notifiedClients[client] = reply;
+            else notifiedClients.erase(client);
+            p << osc::BeginMessage("/done") << "/notify" << 0 << 1 << osc::EndMessage;
+            sendReply(p, client, reply);
+            break;
+        }
+
+        case ofxSCAddressHash("/s_new"):
+        {
+            Node node;
+            int nodeID = -1;
+            int addAction = 0;
+            int target = 0;
+            if(!readString(arg, end, node.defName) || !readInt(arg, end, nodeID)){
+                sendFail("/s_new", "missing arguments", client, reply);
+                break;
+            }
+            readInt(arg, end, addAction);
+            readInt(arg, end, target);
+            while(arg != end){
+                std::string name;
+                float value;
+                if(!readControlName(arg, end, name)){ skipArg(arg, end); skipArg(arg, end); continue; }
+                if(!readFloat(arg, end, value)){ skipArg(arg, end); continue; }
+                node.controls.emplace_back(name, value);
+            }
+            node.id = nodeID == -1 ? nextAutoNodeID-- : nodeID;
+            addNode(node, addAction, target, "/s_new", client, reply);
+            break;
+        }
+
+        case ofxSCAddressHash("/g_new"):
+        case ofxSCAddressHash("/p_new"):
+        {
+            int nodeID, addAction, target;
+            while(readInt(arg, end, nodeID) && readInt(arg, end, addAction) && readInt(arg, end, target)){
+                Node node;
+                node.id = nodeID == -1 ? nextAutoNodeID-- : nodeID;
+                node.isGroup = true;
+                if(!addNode(node, addAction, target, address, client, reply)) break;
+            }
+            break;
+        }
+
+        case ofxSCAddressHash("/n_free"):
+        {
+            int nodeID;
+            while(readInt(arg, end, nodeID)){
+                if(nodes.count(nodeID)) freeNode(nodeID);
+                else sendFail("/n_free", "node not found", client, reply);
+            }
+            break;
+        }
+
+        case ofxSCAddressHash("/n_set"):
+        {
+            int nodeID;
+            if(!readInt(arg, end, nodeID)) break;
+            auto it = nodes.find(nodeID);
+            if(it == nodes.end()){
+                sendFail("/n_set", "node not found", client, reply);
+                break;
+            }
+            while(arg != end){
+                std::string name;
+                float value;
+                if(!readControlName(arg, end, name)){ skipArg(arg, end); skipArg(arg, end); continue; }
+                if(!readFloat(arg, end, value)){ skipArg(arg, end); continue; }
+                // groups pass controls on to every synth inside them, keeping the value is enough here
+                auto &controls = it->second.controls;
+                auto control = std::find_if(controls.begin(), controls.end(), [&](const std::pair<std::string, float> &c){ return c.first == name; });
+                if(control != controls.end()) control->second = value;
+                else controls.emplace_back(name, value);
+            }
+            break;
+        }
+
+        case ofxSCAddressHash("/n_run"):
+        {
+            int nodeID, flag;
+            while(readInt(arg, end, nodeID) && readInt(arg, end, flag)){
+                auto it = nodes.find(nodeID);
+                if(it == nodes.end()){
+                    sendFail("/n_run", "node not found", client, reply);
+                    continue;
+                }
+                if(it->second.running == (flag != 0)) continue;
+                it->second.running = flag != 0;
+                notifyClients(flag ? "/n_on" : "/n_off", it->second);
+            }
+            break;
+        }
+
+        case ofxSCAddressHash("/n_query"):
+        {
+            int nodeID;
+            while(readInt(arg, end, nodeID)){
+                auto it = nodes.find(nodeID);
+                if(it == nodes.end()){
+                    sendFail("/n_query", "node not found", client, reply);
+                    continue;
+                }
+                p.Clear();
+                p << osc::BeginMessage("/n_info");
+                appendNodeArgs(it->second, p);
+                p << osc::EndMessage;
+                sendReply(p, client, reply);
+            }
+            break;
+        }
+
+        case ofxSCAddressHash("/g_freeAll"):
+        case ofxSCAddressHash("/g_deepFree"):
+        {
+            bool synthsOnly = std::string(address) == "/g_deepFree";
+            int groupID;
+            while(readInt(arg, end, groupID)){
+                auto it = nodes.find(groupID);
+                if(it == nodes.end() || !it->second.isGroup){
+                    sendFail(address, "group not found", client, reply);
+                    continue;
+                }
+                freeChildren(groupID, synthsOnly);
+            }
+            break;
+        }
+
+        case ofxSCAddressHash("/g_queryTree"):
+        {
+            int groupID, flag;
+            while(readInt(arg, end, groupID) && readInt(arg, end, flag)){
+                auto it = nodes.find(groupID);
+                if(it == nodes.end() || !it->second.isGroup){
+                    sendFail("/g_queryTree", "group not found", client, reply);
+                    continue;
+                }
+                p.Clear();
+                p << osc::BeginMessage("/g_queryTree.reply") << flag;
+                appendTree(it->second, flag != 0, p);
+                p << osc::EndMessage;
+                sendReply(p, client, reply);
+            }
+            break;
+        }
+
+        case ofxSCAddressHash("/c_set"):
+        {
+            int index;
+            float value;
+            while(readInt(arg, end, index) && readFloat(arg, end, value)){
+                controlBusses[index] = value;
+            }
+            break;
+        }
+
+        case ofxSCAddressHash("/c_setn"):
+        {
+            int index, count;
+            while(readInt(arg, end, index) && readInt(arg, end, count)){
+                float value;
+                for(int i = 0; i < count && readFloat(arg, end, value); i++){
+                    controlBusses[index + i] = value;
+                }
+            }
+            break;
+        }
+
+        case ofxSCAddressHash("/c_fill"):
+        {
+            int index, count;
+            float value;
+            while(readInt(arg, end, index) && readInt(arg, end, count) && readFloat(arg, end, value)){
+                for(int i = 0; i < count; i++){
+                    controlBusses[index + i] = value;
+                }
+            }
+            break;
+        }
+
+        case ofxSCAddressHash("/c_get"):
+        {
+            int index;
+            p << osc::BeginMessage("/c_set");
+            while(readInt(arg, end, index)){
+                auto it = controlBusses.find(index);
+                p << index << (it == controlBusses.end() ? 0.0f : it->second);
+            }
+            p << osc::EndMessage;
+            sendReply(p, client, reply);
+            break;
+        }
+
+        case ofxSCAddressHash("/b_alloc"):
+        case ofxSCAddressHash("/b_allocRead"):
+        {
+            int bufnum = 0;
+            Buffer buffer;
+            if(!readInt(arg, end, bufnum)){
+                sendFail(address, "missing buffer number", client, reply);
+                break;
+            }
+            if(std::string(address) == "/b_alloc"){
+                buffer.frames = 0;
+                buffer.channels = 1;
+                readInt(arg, end, buffer.frames);
+                readInt(arg, end, buffer.channels);
+            }
+            else{
+                // no file is read: whatever was asked for, or a second of mono
+                std::string path;
+                int startFrame = 0;
+                int numFrames = 0;
+                readString(arg, end, path);
+                readInt(arg, end, startFrame);
+                readInt(arg, end, numFrames);
+                buffer.frames = numFrames > 0 ? numFrames : (int)settings.sampleRate;
+                buffer.channels = 1;
+            }
+            buffers[bufnum] = buffer;
+            p << osc::BeginMessage("/done") << address << bufnum << osc::EndMessage;
+            sendReply(p, client, reply);
+            break;
+        }
+
+        case ofxSCAddressHash("/b_free"):
+        {
+            int bufnum = 0;
+            readInt(arg, end, bufnum);
+            buffers.erase(bufnum);
+            p << osc::BeginMessage("/done") << "/b_free" << bufnum << osc::EndMessage;
+            sendReply(p, client, reply);
+            break;
+        }
+
+        case ofxSCAddressHash("/b_query"):
+        {
+            int bufnum;
+            p << osc::BeginMessage("/b_info");
+            while(readInt(arg, end, bufnum)){
+                auto it = buffers.find(bufnum);
+                Buffer buffer = it == buffers.end() ? Buffer() : it->second;
+                p << bufnum << buffer.frames << buffer.channels << (float)settings.sampleRate;
+            }
+            p << osc::EndMessage;
+            sendReply(p, client, reply);
+            break;
+        }
+
+        case ofxSCAddressHash("/b_set"):
+        case ofxSCAddressHash("/b_setn"):
+        case ofxSCAddressHash("/b_fill"):
+        case ofxSCAddressHash("/b_zero"):
+        {
+            // sample data isn't kept, only the buffer has to exist
+            int bufnum = 0;
+            readInt(arg, end, bufnum);
+            if(!buffers.count(bufnum)){
+                sendFail(address, "buffer not allocated", client, reply);
+            }
+            else if(std::string(address) == "/b_zero"){
+                p << osc::BeginMessage("/done") << "/b_zero" << bufnum << osc::EndMessage;
+                sendReply(p, client, reply);
+            }
+            break;
+        }
+
+        case ofxSCAddressHash("/d_recv"):
+        case ofxSCAddressHash("/d_load"):
+        case ofxSCAddressHash("/d_loadDir"):
+        {
+            numSynthDefs++;
+            p << osc::BeginMessage("/done") << address << osc::EndMessage;
+            sendReply(p, client, reply);
+            break;
+        }
+
+        case ofxSCAddressHash("/quit"):
+        {
+            p << osc::BeginMessage("/done") << "/quit" << osc::EndMessage;
+            sendReply(p, client, reply);
+            break;
+        }
+
+        default:
+            sendFail(address, "Command not found", client, reply);
+            break;
+    }
+}
+
+//--------------------------------------------------------------
+bool ofxSCMockServer::addNode(Node &node, int addAction, int targetID, const char *command, uint64_t client, const ReplyFunction &reply)
+{
+    if(nodes.count(node.id)){
+        sendFail(command, "duplicate node ID", client, reply);
+        return false;
+    }
+    auto target = nodes.find(targetID);
+    bool needsGroup = addAction == 0 || addAction == 1;
+    bool needsParent = addAction >= 2 && addAction <= 4;
+    if(target == nodes.end() || (needsGroup && !target->second.isGroup) || (needsParent && targetID == 0) || addAction < 0 || addAction > 4){
+        sendFail(command, "invalid target or add action", client, reply);
+        return false;
+    }
+
+    // unordered_map keeps references valid while it grows
+    Node &added = nodes[node.id] = std::move(node);
+    Node &targetNode = nodes[targetID];
+    link(added, addAction, targetNode);
+    notifyClients("/n_go", added);
+    if(addAction == 4){
+        freeNode(targetID);
+    }
+    return true;
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::link(Node &node, int addAction, Node &target)
+{
+    switch(addAction){
+        case 0:     // head of target
+            node.parent = target.id;
+            node.prev = -1;
+            node.next = target.head;
+            if(target.head != -1) nodes[target.head].prev = node.id;
+            else target.tail = node.id;
+            target.head = node.id;
+            break;
+        case 1:     // tail of target
+            node.parent = target.id;
+            node.next = -1;
+            node.prev = target.tail;
+            if(target.tail != -1) nodes[target.tail].next = node.id;
+            else target.head = node.id;
+            target.tail = node.id;
+            break;
+        case 2:     // before target
+        case 4:     // replace target, which is freed afterwards
+        {
+            Node &group = nodes[target.parent];
+            node.parent = target.parent;
+            node.next = target.id;
+            node.prev = target.prev;
+            if(target.prev != -1) nodes[target.prev].next = node.id;
+            else group.head = node.id;
+            target.prev = node.id;
+            break;
+        }
+        case 3:     // after target
+        {
+            Node &group = nodes[target.parent];
+            node.parent = target.parent;
+            node.prev = target.id;
+            node.next = target.next;
+            if(target.next != -1) nodes[target.next].prev = node.id;
+            else group.tail = node.id;
+            target.next = node.id;
+            break;
+        }
+    }
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::unlink(Node &node)
+{
+    Node &group = nodes[node.parent];
+    if(node.prev != -1) nodes[node.prev].next = node.next;
+    else group.head = node.next;
+    if(node.next != -1) nodes[node.next].prev = node.prev;
+    else group.tail = node.prev;
+    node.prev = node.next = -1;
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::freeNode(int nodeID)
+{
+    // the root group stays
+    if(nodeID == 0) return;
+    auto it = nodes.find(nodeID);
+    if(it == nodes.end()) return;
+
+    if(it->second.isGroup) freeChildren(nodeID, false);
+    notifyClients("/n_end", it->second);
+    unlink(it->second);
+    nodes.erase(it);
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::freeChildren(int groupID, bool synthsOnly)
+{
+    int child = nodes[groupID].head;
+    while(child != -1){
+        Node &node = nodes[child];
+        int next = node.next;
+        if(node.isGroup && synthsOnly) freeChildren(child, true);
+        else freeNode(child);
+        child = next;
+    }
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::appendNodeArgs(const Node &node, osc::OutboundPacketStream &p)
+{
+    p << node.id << node.parent << node.prev << node.next << (node.isGroup ? 1 : 0);
+    if(node.isGroup) p << node.head << node.tail;
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::appendTree(const Node &node, bool controls, osc::OutboundPacketStream &p)
+{
+    p << node.id;
+    if(node.isGroup){
+        int numChildren = 0;
+        for(int child = node.head; child != -1; child = nodes[child].next) numChildren++;
+        p << numChildren;
+        for(int child = node.head; child != -1; child = nodes[child].next){
+            appendTree(nodes[child], controls, p);
+        }
+    }
+    else{
+        p << -1 << node.defName.c_str();
+        if(controls){
+            p << (int)node.controls.size();
+            for(auto &control : node.controls){
+                p << control.first.c_str() << control.second;
+            }
+        }
+    }
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::sendFail(const char *command, const char *error, uint64_t client, const ReplyFunction &reply)
+{
+    osc::OutboundPacketStream p(replyBuffer.data(), replyBuffer.size());
+    p << osc::BeginMessage("/fail") << command << error << osc::EndMessage;
+    sendReply(p, client, reply);
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::notifyClients(const char *address, const Node &node)
+{
+    if(notifiedClients.empty()) return;
+
+    // own buffer, the command may still be building its reply in replyBuffer
+    char buffer[64];
+    osc::OutboundPacketStream p(buffer, sizeof(buffer));
+    p << osc::BeginMessage(address);
+    appendNodeArgs(node, p);
+    p << osc::EndMessage;
+    for(auto &it : notifiedClients){
+        sendReply(p, it.first, it.second);
+    }
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::sendTriggerBurst(int count, int nodeID, int triggerID)
+{
+    std::lock_guard<std::recursive_mutex> deliveryLock(deliveryMutex);
+    std::vector<PendingReply> replies;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        char buffer[64];
+        for(int i = 0; i < count; i++){
+            osc::OutboundPacketStream p(buffer, sizeof(buffer));
+            p << osc::BeginMessage("/tr") << nodeID << triggerID << (float)i << osc::EndMessage;
+            for(auto &it : notifiedClients){
+                sendReply(p, it.first, it.second);
+            }
+        }
+        replies.swap(outbox);
+    }
+    deliver(replies);
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::sendReply(const osc::OutboundPacketStream &p, uint64_t client, const ReplyFunction &reply)
+{
+    std::uniform_real_distribution<float> chance(0, 1);
+    if(settings.replyLoss > 0 && chance(random) < settings.replyLoss){
+        stats.repliesDropped++;
+        return;
+    }
+    stats.repliesSent++;
+
+    PendingReply r;
+    r.order = nextReplyOrder++;
+    r.data.assign(p.Data(), p.Data() + p.Size());
+    r.client = client;
+    r.reply = reply;
+
+    double wait = settings.delay + (settings.jitter > 0 ? settings.jitter * chance(random) : 0);
+    if(wait <= 0 && settings.burstInterval <= 0){
+        outbox.push_back(std::move(r));
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    r.due = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(wait));
+    if(settings.burstInterval > 0){
+        // everything due within the same interval goes out together at its end
+        auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(settings.burstInterval));
+        if(interval.count() > 0){
+            auto sinceEpoch = r.due.time_since_epoch();
+            r.due = std::chrono::steady_clock::time_point(((sinceEpoch + interval - std::chrono::steady_clock::duration(1)) / interval) * interval);
+        }
+    }
+    pending.push_back(std::move(r));
+    std::push_heap(pending.begin(), pending.end(), std::greater<PendingReply>());
+
+    // started the first time a reply has to wait
+    if(!schedulerThread.joinable()){
+        schedulerRunning = true;
+        schedulerThread = std::thread(&ofxSCMockServer::schedulerThreadFunction, this);
+    }
+    pendingChanged.notify_one();
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::deliver(std::vector<PendingReply> &replies)
+{
+    for(auto &r : replies){
+        r.reply(r.data.data(), r.data.size());
+    }
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::schedulerThreadFunction()
+{
+    std::vector<PendingReply> ready;
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if(!schedulerRunning) return;
+            if(pending.empty()){
+                pendingChanged.wait(lock);
+                continue;
+            }
+            if(std::chrono::steady_clock::now() < pending.front().due){
+                pendingChanged.wait_until(lock, pending.front().due);
+                continue;
+            }
+        }
+
+        // lock in the same order as handlePacket(), then take everything that is due in one go, which is what makes bursts
+        std::lock_guard<std::recursive_mutex> deliveryLock(deliveryMutex);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto now = std::chrono::steady_clock::now();
+            while(!pending.empty() && pending.front().due <= now){
+                std::pop_heap(pending.begin(), pending.end(), std::greater<PendingReply>());
+                ready.push_back(std::move(pending.back()));
+                pending.pop_back();
+            }
+        }
+        deliver(ready);
+        ready.clear();
+    }
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::setSettings(const ofxSCMockServerSettings &_settings)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    bool reseed = _settings.seed != settings.seed;
+    settings = _settings;
+    if(reseed) random.seed(settings.seed);
+}
+
+//--------------------------------------------------------------
+ofxSCMockServerSettings ofxSCMockServer::getSettings() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return settings;
+}
+
+//--------------------------------------------------------------
+void ofxSCMockServer::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    nodes.clear();
+    Node root;
+    root.id = 0;
+    root.isGroup = true;
+    nodes[0] = root;
+    if(settings.defaultGroup){
+        Node &group = nodes[1];
+        group.id = 1;
+        group.isGroup = true;
+        link(group, 0, nodes[0]);
+    }
+    controlBusses.clear();
+    buffers.clear();
+    notifiedClients.clear();
+    numSynthDefs = 0;
+    // -1 asks for an automatic ID, scsynth hands out negative ones below it
+    nextAutoNodeID = -2;
+}
+
+//--------------------------------------------------------------
+bool ofxSCMockServer::hasNode(int nodeID) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return nodes.count(nodeID) > 0;
+}
+
+//--------------------------------------------------------------
+int ofxSCMockServer::getNumSynths() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int count = 0;
+    for(auto &it : nodes){
+        if(!it.second.isGroup) count++;
+    }
+    return count;
+}
+
+//--------------------------------------------------------------
+int ofxSCMockServer::getNumGroups() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int count = 0;
+    for(auto &it : nodes){
+        if(it.second.isGroup) count++;
+    }
+    return count;
+}
+
+//--------------------------------------------------------------
+float ofxSCMockServer::getControlBus(int index) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = controlBusses.find(index);
+    return it == controlBusses.end() ? 0 : it->second;
+}
+
+//--------------------------------------------------------------
+ofxSCMockServerStats ofxSCMockServer::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
@@ -0,0 +1,177 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <random>
+#include <chrono>
+
+#include "OscReceivedElements.h"
+#include "OscOutboundPacketStream.h"
+#include "ofxSCTransport.h"
+#include "ofxSCUdpSocket.h"
+
+struct ofxSCMockServerSettings {
+    int port = 57110;               ///< UDP port start() listens on
+    double sampleRate = 48000;      ///< reported by /status.reply and /b_info
+    float delay = 0;                ///< seconds before each reply is sent
+    float jitter = 0;               ///< up to this many seconds added to delay at random, can reorder replies
+    float requestLoss = 0;          ///< chance of ignoring an incoming packet, 0 to 1
+    float replyLoss = 0;            ///< chance of dropping each reply, 0 to 1
+    float burstInterval = 0;        ///< if > 0, replies are held and released together every this many seconds
+    unsigned int seed = 1;          ///< seeds loss and jitter, the same seed gives the same run
+    bool defaultGroup = true;       ///< start with group 1 in the root, like sclang makes on boot
+};
+
+struct ofxSCMockServerStats {
+    uint64_t packetsReceived = 0;
+    uint64_t packetsDropped = 0;    ///< ignored because of requestLoss or malformed
+    uint64_t messagesHandled = 0;
+    uint64_t repliesSent = 0;
+    uint64_t repliesDropped = 0;    ///< because of replyLoss
+};
+
+/// Stand-in for scsynth, for testing and benchmarking without a real server.
+/// It keeps a node tree, control busses and buffer sizes and answers the way
+/// scsynth does: /status, /sync, /notify, /s_new, /g_new, /n_free, /n_set,
+/// /n_run, /n_query, /g_freeAll, /g_deepFree, /g_queryTree, /c_set, /c_setn,
+/// /c_fill, /c_get, /b_alloc, /b_allocRead, /b_free, /b_query, /b_set,
+/// /b_setn, /b_fill, /b_zero, /d_recv, /d_load and /quit. Node notifications go to clients that sent /notify 1.
+/// Nothing makes sound, timetags are ignored and bundles run when they arrive.
+///
+/// Reach it over UDP with start(), or in process through createTransport().
+class ofxSCMockServer
+{
+public:
+    typedef std::function<void(const char *data, size_t size)> ReplyFunction;
+
+    explicit ofxSCMockServer(const ofxSCMockServerSettings &settings = ofxSCMockServerSettings());
+    ~ofxSCMockServer();
+
+    /// listen on settings.port. Not available on Windows
+    /// \return true on success
+    bool start();
+    void stop();
+    bool isRunning() const;
+
+    /// \return a transport for ofxSCServer::setTransport() that talks to this
+    /// mock through function calls. The mock must outlive it
+    std::unique_ptr<ofxSCTransport> createTransport();
+
+    /// handle a packet as if it came from the client identified by clientKey,
+    /// replies to it go to reply. Thread safe
+    void handlePacket(const char *data, size_t size, uint64_t clientKey, ReplyFunction reply);
+
+    /// forget a client: its /notify registration and the replies still waiting for it
+    void removeClient(uint64_t clientKey);
+
+    /// send count /tr messages at once to every notified client, to load the receive path
+    void sendTriggerBurst(int count, int nodeID = 0, int triggerID = 0);
+
+    void setSettings(const ofxSCMockServerSettings &settings);
+    ofxSCMockServerSettings getSettings() const;
+
+    /// back to an empty root group (and the default group), no busses, buffers or clients.
+    /// Stats keep counting
+    void reset();
+
+    bool hasNode(int nodeID) const;
+    int getNumSynths() const;
+    int getNumGroups() const;
+    float getControlBus(int index) const;
+    ofxSCMockServerStats getStats() const;
+
+private:
+    struct Node{
+        int id = 0;
+        int parent = -1;
+        int prev = -1;
+        int next = -1;
+        bool isGroup = false;
+        bool running = true;
+        int head = -1;              ///< groups only
+        int tail = -1;
+        std::string defName;        ///< synths only
+        std::vector<std::pair<std::string, float>> controls;
+    };
+    struct Buffer{
+        int frames = 0;
+        int channels = 0;
+    };
+    struct PendingReply{
+        std::chrono::steady_clock::time_point due;
+        uint64_t order;             ///< keeps replies due at the same time in order
+        std::vector<char> data;
+        uint64_t client;
+        ReplyFunction reply;
+        bool operator>(const PendingReply &other) const {
+            return due > other.due || (due == other.due && order > other.order);
+        }
+    };
+
+    void handleElement(const char *data, size_t size, uint64_t client, const ReplyFunction &reply);
+    void handleMessage(const osc::ReceivedMessage &m, uint64_t client, const ReplyFunction &reply);
+
+    bool addNode(Node &node, int addAction, int target, const char *command, uint64_t client, const ReplyFunction &reply);
+    void link(Node &node, int addAction, Node &target);
+    void unlink(Node &node);
+    void freeNode(int nodeID);
+    void freeChildren(int groupID, bool synthsOnly);
+    void appendTree(const Node &node, bool controls, osc::OutboundPacketStream &p);
+    void appendNodeArgs(const Node &node, osc::OutboundPacketStream &p);
+    void sendFail(const char *command, const char *error, uint64_t client, const ReplyFunction &reply);
+
+    /// replies go through here: loss, delay and bursts are applied
+    void sendReply(const osc::OutboundPacketStream &p, uint64_t client, const ReplyFunction &reply);
+    void notifyClients(const char *address, const Node &node);
+    void deliver(std::vector<PendingReply> &replies);
+    void schedulerThreadFunction();
+
+    ofxSCMockServerSettings settings;
+    /// held from handling a packet until its replies are handed out, so
+    /// removeClient() can wait for them. Always taken before mutex, and
+    /// recursive because a client may send again from inside its reply
+    std::recursive_mutex deliveryMutex;
+    mutable std::mutex mutex;           ///< everything below
+
+    std::unordered_map<int, Node> nodes;
+    std::map<int, float> controlBusses;
+    std::unordered_map<int, Buffer> buffers;
+    std::unordered_map<uint64_t, ReplyFunction> notifiedClients;
+    int numSynthDefs;
+    int nextAutoNodeID;
+    uint64_t nextLoopbackClient;
+    ofxSCMockServerStats stats;
+    std::mt19937 random;
+    std::vector<char> replyBuffer;
+
+    std::vector<PendingReply> outbox;   ///< due now, sent once mutex is released
+    std::vector<PendingReply> pending;  ///< min-heap on due time
+    uint64_t nextReplyOrder;
+    std::condition_variable pendingChanged;
+    std::thread schedulerThread;
+    bool schedulerRunning;
+
+#ifdef OFXSC_HAS_NATIVE_SOCKETS
+    std::unique_ptr<ofxSCUdpSocket> socket;
+#endif
+};
@@ -14,12 +14,14 @@
 #include "ofxSCNode.h"
 #include "ofxSCGroup.h"
 
-int ofxSCNode::id_base = 2000;
+std::atomic<int> ofxSCNode::id_base(2000);
 
 ofxSCNode::ofxSCNode(ofxSCServer *_server)
 {
 	nodeID = 0;
 	created = false;
+    ended = false;
+    claimedNodeID = 0;
     server = nullptr;
     setServer(_server);
 }
@@ -54,6 +56,9 @@ void ofxSCNode::run(bool b){
 
 void ofxSCNode::free()
 {
+    // held /n_set for this node must reach the server before it goes away
+    server->flushCoalesced();
+    
 	ofxOscMessage m;
 	m.setAddress("/n_free");
 	m.addIntArg(nodeID);
@@ -129,10 +134,7 @@ void ofxSCNode::moveAfter(int _nodeID){
 
 void ofxSCNode::feedbackListener(ofxOscMessage &msg){
     if(msg.getAddress() == "/n_go"){
-        created = true;
-        for(auto &m : storedMessages) server->sendMsg(m);
-        storedMessages.clear();
-        resendStoredArgs();
+        started();
     }else if(msg.getAddress() == "/n_end"){
         created = false;
     }else if(msg.getAddress() == "/n_off"){
@@ -150,6 +152,21 @@ void ofxSCNode::feedbackListener(ofxOscMessage &msg){
     }
 }
 
+void ofxSCNode::feedbackEvent(const ofxSCReplyEvent &e){
+    if(e.type == OFXSC_REPLY_NODE_GO){
+        started();
+    }else if(e.type == OFXSC_REPLY_NODE_END){
+        created = false;
+    }
+}
+
+void ofxSCNode::started(){
+    created = true;
+    for(auto &m : storedMessages) server->sendMsg(m);
+    storedMessages.clear();
+    resendStoredArgs();
+}
+
 void ofxSCNode::setServer(ofxSCServer *_server){
     if(server != nullptr)
         server->removeNodeListener(this);
@@ -162,3 +179,28 @@ void ofxSCNode::setServer(ofxSCServer *_server){
 ofxSCServer* ofxSCNode::getServer(){
     return server;
 }
+
+void ofxSCNode::claimNodeID(){
+    if(server == nullptr) return;
+    if(nodeID == 0 || nodeID == claimedNodeID){
+        // Created again. Once the node before has ended its id is ours to use
+        // again, otherwise its /n_end may still be on the way and must not end
+        // this one, so it gets a new id and the old one is recycled once that
+        // /n_end is in
+        if(nodeID != 0 && server->reclaimEndedNodeID(this)) return;
+        setNodeID(server->getNodeIDAllocator().alloc());
+        claimedNodeID = nodeID;
+    }else{
+        // an id picked by hand, created again under the same id
+        server->addNodeListener(this);
+    }
+}
+
+void ofxSCNode::setNodeID(int _nodeID){
+    if(server != nullptr)
+        server->removeNodeListener(this);
+    
+    nodeID = _nodeID;
+    if(server != nullptr)
+        server->addNodeListener(this);
+}
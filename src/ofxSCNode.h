@@ -14,6 +14,7 @@
 #pragma once
 
 #include <vector>
+#include <atomic>
 #include "ofxOsc.h"
 #include "ofxSCServer.h"
 
@@ -21,6 +22,8 @@ class ofxSCGroup;
 
 class ofxSCNode
 {
+    friend class ofxSCServer;
+    
 public:	
 	ofxSCNode(ofxSCServer *server = ofxSCServer::local());
 	~ofxSCNode();
@@ -45,12 +48,19 @@ public:
     void run(bool b);
 	void free();
 
-	static int id_base;
+	/// Deprecated, ids come from ofxSCServer::getNodeIDAllocator(). Read as the
+	/// first id of each partition when a server is created, not advanced anymore
+	static std::atomic<int> id_base;
 	
 	// can't use 'id' as a keyword when mixing with objective-c!
+	/// Taken from the server's allocator on create(). Created again, a synth keeps
+	/// its id if the server already ended the node before (/n_end arrived), and
+	/// gets a new one otherwise, so a late /n_end can't end the new node. Groups
+	/// get a new one on every create(). Ids set by hand are kept
 	int nodeID;
     
     void feedbackListener(ofxOscMessage &msg);
+    void feedbackEvent(const ofxSCReplyEvent &e);
     virtual void resendStoredArgs(){};
 		
     ofEvent<ofxOscMessage> newFeedbackMessage;
@@ -58,11 +68,23 @@ protected:
     
     void setServer(ofxSCServer *_server);
     ofxSCServer* getServer();
+    
+    /// change nodeID and keep the server node index in sync
+    void setNodeID(int _nodeID);
+    /// take a node id from the server before sending /s_new, see nodeID
+    void claimNodeID();
 
 	bool created;
+    /// the server sent /n_end and the id goes back to the server's allocator once
+    /// this node lets go of it. Only touched under the server's node index lock
+    bool ended;
+    /// the id claimNodeID() last took from the allocator
+    int claimedNodeID;
     
 private:
     
+    void started();
+    
     ofxSCServer *server;
     std::vector<ofxOscMessage> storedMessages;
 };
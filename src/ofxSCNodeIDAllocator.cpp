@@ -0,0 +1,112 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCNodeIDAllocator.h"
+
+#include <algorithm>
+
+#include "ofLog.h"
+
+//--------------------------------------------------------------
+ofxSCNodeIDAllocator::ofxSCNodeIDAllocator(int firstID, size_t recycleCapacity, int maxIDs)
+    : firstID(firstID), maxIDs(std::max(0, std::min(maxIDs, (1 << clientBits) - firstID))),
+      clientID(0), next(firstID), issued(new std::atomic<uint64_t>[(this->maxIDs + 63) / 64]),
+      recycled(recycleCapacity), dropped(0), exhausted(false)
+{
+    clearIssued();
+}
+
+//--------------------------------------------------------------
+int ofxSCNodeIDAllocator::alloc()
+{
+    int client = clientID.load(std::memory_order_acquire);
+    int nodeID;
+    while(recycled.pop(nodeID)){
+        // left over from before a client id change
+        int offset = offsetOf(nodeID, client);
+        if(offset >= 0 && markIssued(offset, true)) return nodeID;
+    }
+
+    nodeID = next.fetch_add(1, std::memory_order_relaxed);
+    int offset = offsetOf(nodeID, client);
+    if(offset >= 0){
+        markIssued(offset, true);
+        return nodeID;
+    }
+
+    // undo, so the counter doesn't run on into the next partition
+    next.fetch_sub(1, std::memory_order_relaxed);
+    if(!exhausted.exchange(true)){
+        ofLogError("ofxSCNodeIDAllocator") << "node ids of client " << client << " used up, the server picks them from now on";
+    }
+    return -1;
+}
+
+//--------------------------------------------------------------
+void ofxSCNodeIDAllocator::free(int nodeID)
+{
+    // /n_end also comes for nodes of other clients, and for ids picked by hand
+    int offset = offsetOf(nodeID, clientID.load(std::memory_order_acquire));
+    if(offset < 0 || !markIssued(offset, false)) return;
+    if(!recycled.push(nodeID)){
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }else{
+        exhausted.store(false, std::memory_order_relaxed);
+    }
+}
+
+//--------------------------------------------------------------
+void ofxSCNodeIDAllocator::setClientID(int client)
+{
+    if(client < 0 || client > maxClientID){
+        ofLogError("ofxSCNodeIDAllocator") << "client id " << client << " out of range 0 to " << maxClientID;
+        return;
+    }
+    if(client == clientID.load()) return;
+    next.store((client << clientBits) + firstID);
+    clearIssued();
+    clientID.store(client, std::memory_order_release);
+    exhausted.store(false);
+}
+
+//--------------------------------------------------------------
+int ofxSCNodeIDAllocator::getHighWater() const
+{
+    return next.load(std::memory_order_relaxed) - (getClientID() << clientBits) - firstID;
+}
+
+//--------------------------------------------------------------
+int ofxSCNodeIDAllocator::offsetOf(int nodeID, int client) const
+{
+    // maxIDs ends within the partition, so this also keeps the counter from
+    // running into the next one. Past the last partition the counter wraps negative
+    int64_t offset = int64_t(nodeID) - ((int64_t(client) << clientBits) + firstID);
+    return offset >= 0 && offset < maxIDs ? int(offset) : -1;
+}
+
+//--------------------------------------------------------------
+bool ofxSCNodeIDAllocator::markIssued(int offset, bool value)
+{
+    std::atomic<uint64_t> &word = issued[offset >> 6];
+    uint64_t bit = uint64_t(1) << (offset & 63);
+    uint64_t old = value ? word.fetch_or(bit, std::memory_order_acq_rel) : word.fetch_and(~bit, std::memory_order_acq_rel);
+    return ((old & bit) != 0) != value;
+}
+
+//--------------------------------------------------------------
+void ofxSCNodeIDAllocator::clearIssued()
+{
+    for(int i = 0; i < (maxIDs + 63) / 64; i++){
+        issued[i].store(0, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,80 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "ofxSCRingBuffer.h"
+
+/// Node ids for one client of a server. Like sclang, the id space is split
+/// per client id, client n owning ids n << 26 up to (n + 1) << 26, so clients
+/// sharing a server never collide. Ids freed once the server confirmed the
+/// node is gone (/n_end) are handed out again before new ones, oldest first,
+/// which keeps the ids in use dense and leaves a freed id unused for as long
+/// as possible. Only ids handed out here and not freed since are taken back,
+/// so a foreign id or a second /n_end for the same node can't put an id in
+/// the queue twice. alloc() and free() are lock-free and, once reserve() has
+/// allocated the recycle queue, don't allocate, so they can be called from an
+/// audio callback (apart from the error logged once when a partition is used
+/// up). Without reserve() the first free() allocates it.
+class ofxSCNodeIDAllocator
+{
+public:
+    static constexpr int clientBits = 26;
+    static constexpr int maxClientID = 31;
+
+    /// \param firstID first id of each partition, those below are left for ids picked by hand
+    /// \param recycleCapacity freed ids held for reuse, more are dropped
+    /// \param maxIDs ids taken from the partition at most, one bit each tracks whether they're in use
+    explicit ofxSCNodeIDAllocator(int firstID = 2000, size_t recycleCapacity = 16384, int maxIDs = 1 << 18);
+
+    /// allocate the recycle queue now. Not real-time safe
+    void reserve(){recycled.reserve();};
+
+    /// \return a free id, or -1 (the server picks one) if the partition is used up
+    int alloc();
+    /// give back an id the server is done with. Ids not handed out by alloc(), or
+    /// freed already, are ignored
+    void free(int nodeID);
+
+    /// move to the partition of clientID, e.g. from the /done /notify reply. Ids
+    /// handed out before stay valid, but aren't recycled anymore
+    void setClientID(int clientID);
+    int getClientID() const {return clientID.load(std::memory_order_relaxed);};
+
+    /// \return ids ever taken from the partition, recycled ones not counted again
+    int getHighWater() const;
+    /// \return ids freed and waiting to be reused
+    size_t getNumRecycled() const {return recycled.size();};
+    /// \return freed ids that didn't fit in the recycle queue and are lost
+    uint64_t getNumDropped() const {return dropped.load(std::memory_order_relaxed);};
+
+private:
+    /// \return nodeID's offset in the partition of client, or -1 if it's not among the tracked ids
+    int offsetOf(int nodeID, int client) const;
+    /// \return false if the id was already marked so
+    bool markIssued(int offset, bool value);
+    void clearIssued();
+
+    const int firstID;
+    const int maxIDs;
+    std::atomic<int> clientID;
+    std::atomic<int> next;              ///< next never used id of the partition
+    std::unique_ptr<std::atomic<uint64_t>[]> issued; ///< bit per id, set from alloc() until free()
+    ofxSCRingBuffer<int, false> recycled; ///< one push per ended node, not worth a cache line a slot
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> exhausted;        ///< logged once
+};
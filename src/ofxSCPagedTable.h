@@ -0,0 +1,85 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+
+/// Table indexed by non negative integers (node ids, bus and buffer indices).
+/// Slots live in fixed size pages that are allocated the first time one of their
+/// indices is set and released again once they are empty, so a lookup is a shift
+/// and a mask and memory follows the indices actually in use.
+template<typename T, size_t PageBits = 10>
+class ofxSCPagedTable
+{
+public:
+    static constexpr size_t pageSize = size_t(1) << PageBits;
+
+    /// \return the value stored at index, or T() if nothing was set there
+    T get(size_t index) const
+    {
+        size_t page = index >> PageBits;
+        if(page >= pages.size() || !pages[page].slots) return T();
+        return pages[page].slots[index & (pageSize - 1)];
+    }
+
+    void set(size_t index, T value)
+    {
+        if(value == T()){
+            erase(index);
+            return;
+        }
+        size_t page = index >> PageBits;
+        if(page >= pages.size()) pages.resize(page + 1);
+
+        Page &p = pages[page];
+        if(!p.slots) p.slots.reset(new T[pageSize]());
+
+        T &slot = p.slots[index & (pageSize - 1)];
+        if(slot == T()) p.used++;
+        slot = value;
+    }
+
+    void erase(size_t index)
+    {
+        size_t page = index >> PageBits;
+        if(page >= pages.size() || !pages[page].slots) return;
+
+        Page &p = pages[page];
+        T &slot = p.slots[index & (pageSize - 1)];
+        if(slot == T()) return;
+        slot = T();
+        if(--p.used == 0) p.slots.reset();
+    }
+
+    void clear()
+    {
+        pages.clear();
+    }
+
+    /// \return number of pages currently holding at least one value
+    size_t getNumPages() const
+    {
+        size_t n = 0;
+        for(auto &p : pages) if(p.slots) n++;
+        return n;
+    }
+
+private:
+    struct Page{
+        std::unique_ptr<T[]> slots;
+        size_t used = 0;
+    };
+    std::vector<Page> pages;
+};
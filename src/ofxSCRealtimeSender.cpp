@@ -0,0 +1,211 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCRealtimeSender.h"
+
+#include <cstring>
+
+// Writes a bundle holding one message into a packet, OSC encoded by hand so it
+// can't allocate or throw. Everything is big-endian and padded to 4 bytes. Once
+// something doesn't fit, the writer stops and end() returns false.
+class ofxSCPacketWriter
+{
+public:
+    ofxSCPacketWriter(ofxSCEncodedPacket &packet) : packet(packet), pos(0), elementSizePos(0), fits(true) {}
+
+    void beginBundle(uint64_t timetag, const char *address)
+    {
+        write("#bundle", 8);
+        putInt64(timetag);
+        elementSizePos = pos;
+        putInt32(0);
+        putString(address);
+    }
+
+    /// type tags: ',' then fixed, then repeat count times
+    void putTypeTags(const char *fixed, const char *repeat = "", int count = 0)
+    {
+        size_t fixedLength = std::strlen(fixed);
+        size_t repeatLength = std::strlen(repeat);
+        size_t length = 1 + fixedLength + repeatLength * count;
+        if(!reserve(padded(length + 1))) return;
+        char *out = packet.data + pos;
+        *out++ = ',';
+        std::memcpy(out, fixed, fixedLength);
+        out += fixedLength;
+        for(int i = 0; i < count; i++, out += repeatLength) std::memcpy(out, repeat, repeatLength);
+        pad(length);
+    }
+
+    void putInt32(int32_t value)
+    {
+        uint32_t v = (uint32_t)value;
+        unsigned char bytes[4] = {(unsigned char)(v >> 24), (unsigned char)(v >> 16), (unsigned char)(v >> 8), (unsigned char)v};
+        write((const char*)bytes, 4);
+    }
+
+    void putFloat(float value)
+    {
+        uint32_t v;
+        std::memcpy(&v, &value, 4);
+        putInt32((int32_t)v);
+    }
+
+    void putString(const char *s)
+    {
+        size_t length = std::strlen(s);
+        if(!reserve(padded(length + 1))) return;
+        std::memcpy(packet.data + pos, s, length);
+        pad(length);
+    }
+
+    /// \return false if anything didn't fit
+    bool end()
+    {
+        if(!fits) return false;
+        uint32_t elementSize = (uint32_t)(pos - elementSizePos - 4);
+        size_t end = pos;
+        pos = elementSizePos;
+        putInt32((int32_t)elementSize);
+        packet.size = (uint32_t)end;
+        return true;
+    }
+
+private:
+    static size_t padded(size_t size){return (size + 3) & ~(size_t)3;}
+
+    bool reserve(size_t size)
+    {
+        if(fits && pos + size > ofxSCEncodedPacket::capacity) fits = false;
+        return fits;
+    }
+
+    void write(const char *data, size_t size)
+    {
+        if(!reserve(size)) return;
+        std::memcpy(packet.data + pos, data, size);
+        pos += size;
+    }
+
+    void putInt64(uint64_t value)
+    {
+        putInt32((int32_t)(value >> 32));
+        putInt32((int32_t)value);
+    }
+
+    /// zero from pos + length to the next multiple of 4, at least one byte (the terminator)
+    void pad(size_t length)
+    {
+        size_t total = padded(length + 1);
+        std::memset(packet.data + pos + length, 0, total - length);
+        pos += total;
+    }
+
+    ofxSCEncodedPacket &packet;
+    size_t pos;
+    size_t elementSizePos;
+    bool fits;
+};
+
+//--------------------------------------------------------------
+ofxSCRealtimeSender::ofxSCRealtimeSender(ofxSCNodeIDAllocator &nodeIDs, size_t queueSize) : nodeIDs(nodeIDs), queue(queueSize), dropped(0), wakeup(nullptr)
+{
+}
+
+//--------------------------------------------------------------
+void ofxSCRealtimeSender::reserve()
+{
+    queue.reserve();
+    nodeIDs.reserve();
+}
+
+//--------------------------------------------------------------
+int ofxSCRealtimeSender::synthNew(const char *defName, int addAction, int targetID, const ofxSCControlValue *controls, int numControls, uint64_t timetag)
+{
+    int nodeID = nodeIDs.alloc();
+    if(synthNew(nodeID, defName, addAction, targetID, controls, numControls, timetag)) return nodeID;
+    nodeIDs.free(nodeID);
+    return -1;
+}
+
+bool ofxSCRealtimeSender::synthNew(int nodeID, const char *defName, int addAction, int targetID, const ofxSCControlValue *controls, int numControls, uint64_t timetag)
+{
+    ofxSCEncodedPacket packet;
+    ofxSCPacketWriter writer(packet);
+    writer.beginBundle(timetag, "/s_new");
+    writer.putTypeTags("siii", "sf", numControls);
+    writer.putString(defName);
+    writer.putInt32(nodeID);
+    writer.putInt32(addAction);
+    writer.putInt32(targetID);
+    for(int i = 0; i < numControls; i++){
+        writer.putString(controls[i].name);
+        writer.putFloat(controls[i].value);
+    }
+    return push(packet, writer.end());
+}
+
+//--------------------------------------------------------------
+bool ofxSCRealtimeSender::nodeSet(int nodeID, const ofxSCControlValue *controls, int numControls, uint64_t timetag)
+{
+    ofxSCEncodedPacket packet;
+    ofxSCPacketWriter writer(packet);
+    writer.beginBundle(timetag, "/n_set");
+    writer.putTypeTags("i", "sf", numControls);
+    writer.putInt32(nodeID);
+    for(int i = 0; i < numControls; i++){
+        writer.putString(controls[i].name);
+        writer.putFloat(controls[i].value);
+    }
+    return push(packet, writer.end());
+}
+
+bool ofxSCRealtimeSender::nodeSet(int nodeID, const char *control, float value, uint64_t timetag)
+{
+    ofxSCControlValue controlValue = {control, value};
+    return nodeSet(nodeID, &controlValue, 1, timetag);
+}
+
+//--------------------------------------------------------------
+bool ofxSCRealtimeSender::nodeFree(int nodeID, uint64_t timetag)
+{
+    ofxSCEncodedPacket packet;
+    ofxSCPacketWriter writer(packet);
+    writer.beginBundle(timetag, "/n_free");
+    writer.putTypeTags("i");
+    writer.putInt32(nodeID);
+    return push(packet, writer.end());
+}
+
+//--------------------------------------------------------------
+bool ofxSCRealtimeSender::controlSet(int index, float value, uint64_t timetag)
+{
+    ofxSCEncodedPacket packet;
+    ofxSCPacketWriter writer(packet);
+    writer.beginBundle(timetag, "/c_set");
+    writer.putTypeTags("if");
+    writer.putInt32(index);
+    writer.putFloat(value);
+    return push(packet, writer.end());
+}
+
+//--------------------------------------------------------------
+bool ofxSCRealtimeSender::push(ofxSCEncodedPacket &packet, bool encoded)
+{
+    if(!encoded || !queue.push(packet)){
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if(wakeup != nullptr) wakeup->wake();
+    return true;
+}
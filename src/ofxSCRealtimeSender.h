@@ -0,0 +1,94 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+#include "ofxSCRingBuffer.h"
+#include "ofxSCNodeIDAllocator.h"
+#include "ofxSCWakeup.h"
+
+/// a control name and value for ofxSCRealtimeSender, the name isn't copied
+struct ofxSCControlValue {
+    const char *name;
+    float value;
+};
+
+/// an OSC packet encoded where it was sent from, copied through the queue as is
+struct ofxSCEncodedPacket {
+    static constexpr size_t capacity = 512;
+    uint32_t size = 0;
+    char data[capacity];
+};
+
+/// Send path for the common commands that is safe to call from an audio
+/// callback: no allocation, no lock, no exception. Each call encodes its
+/// packet straight into a fixed size slot and pushes it onto a lock-free
+/// queue, which ofxSCServer::process() sends from its own thread (waking the
+/// I/O thread if it sleeps, see ofxSCWakeup). The queue is allocated by
+/// reserve(), which ofxSCServer::getRealtimeSender() calls, so get the
+/// sender before the audio callback runs.
+/// With one real-time thread sending, a push never has to retry.
+///
+/// Packets go out as bundles with the given timetag (1 is now), past the
+/// stored bundle, the sync barriers and the latency setting, and aren't
+/// ordered against messages sent through ofxSCServer::sendMsg. A call that
+/// doesn't fit in ofxSCEncodedPacket::capacity or finds the queue full is
+/// dropped and counted.
+class ofxSCRealtimeSender
+{
+public:
+    /// \param nodeIDs where synthNew() takes node ids from
+    explicit ofxSCRealtimeSender(ofxSCNodeIDAllocator &nodeIDs, size_t queueSize = 1024);
+
+    /// allocate the queue and the node id recycling, or the first call allocates.
+    /// Not real-time safe
+    void reserve();
+
+    /// /s_new with a node id taken from the server's ofxSCNodeIDAllocator
+    /// \return the node id, -1 if it was dropped or the ids are used up and the server picks one
+    int synthNew(const char *defName, int addAction, int targetID, const ofxSCControlValue *controls = nullptr, int numControls = 0, uint64_t timetag = 1);
+    /// /s_new with a node id of your own
+    bool synthNew(int nodeID, const char *defName, int addAction, int targetID, const ofxSCControlValue *controls = nullptr, int numControls = 0, uint64_t timetag = 1);
+    /// /n_set
+    bool nodeSet(int nodeID, const ofxSCControlValue *controls, int numControls, uint64_t timetag = 1);
+    bool nodeSet(int nodeID, const char *control, float value, uint64_t timetag = 1);
+    /// /n_free
+    bool nodeFree(int nodeID, uint64_t timetag = 1);
+    /// /c_set
+    bool controlSet(int index, float value, uint64_t timetag = 1);
+
+    /// call send(const char *data, size_t size) for every queued packet, oldest first.
+    /// Not real-time safe, called by ofxSCServer
+    template<typename F>
+    size_t drain(F &&send){
+        return queue.drain([&](ofxSCEncodedPacket &packet){ send(packet.data, (size_t)packet.size); });
+    }
+    bool empty() const {return queue.empty();};
+    /// woken after each push, set before sending. Not owned
+    void setWakeup(ofxSCWakeup *wakeup){this->wakeup = wakeup;};
+
+    /// \return calls dropped because the queue was full or the packet too big
+    uint64_t getNumDropped() const {return dropped.load(std::memory_order_relaxed);};
+
+private:
+    bool push(ofxSCEncodedPacket &packet, bool encoded);
+
+    ofxSCNodeIDAllocator &nodeIDs;
+    ofxSCRingBuffer<ofxSCEncodedPacket> queue;
+    std::atomic<uint64_t> dropped;
+    ofxSCWakeup *wakeup;
+};
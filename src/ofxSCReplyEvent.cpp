@@ -0,0 +1,170 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCReplyEvent.h"
+
+#include <cstring>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<ofxSCReplyEvent>::value, "ofxSCReplyEvent must stay plain data");
+
+static const char *replyAddresses[OFXSC_REPLY_NUM_TYPES] = {
+    "/n_go", "/n_end", "/n_off", "/n_on", "/n_move", "/tr", "/c_set", "/b_info", "/synced", "/done"
+};
+
+const char *ofxSCReplyEvent::getAddress() const
+{
+    return replyAddresses[type];
+}
+
+void ofxSCReplyEvent::toMessage(ofxOscMessage &m) const
+{
+    m.clear();
+    m.setAddress(getAddress());
+    switch(type){
+        case OFXSC_REPLY_TRIGGER:
+            m.addIntArg(args[0]);
+            m.addIntArg(args[1]);
+            m.addFloatArg(value);
+            break;
+        case OFXSC_REPLY_CONTROL_SET:
+            m.addIntArg(args[0]);
+            m.addFloatArg(value);
+            break;
+        case OFXSC_REPLY_BUFFER_INFO:
+            m.addIntArg(args[0]);
+            m.addIntArg(args[1]);
+            m.addIntArg(args[2]);
+            m.addFloatArg(value);
+            break;
+        case OFXSC_REPLY_DONE:
+            m.addStringArg(command);
+            for(int i = 0; i < numArgs; i++) m.addIntArg(args[i]);
+            break;
+        default:
+            for(int i = 0; i < numArgs; i++) m.addIntArg(args[i]);
+            break;
+    }
+}
+
+//--------------------------------------------------------------
+static ofxSCReplyEvent &newEvent(ofxSCReplyEvent *events, int index, ofxSCReplyType type)
+{
+    ofxSCReplyEvent &e = events[index];
+    e.type = type;
+    e.numArgs = 0;
+    e.value = 0;
+    e.command[0] = 0;
+    return e;
+}
+
+//--------------------------------------------------------------
+int ofxSCDecodeReply(const osc::ReceivedMessage &m, ofxSCReplyEvent *events, int maxEvents)
+{
+    const char *address = m.AddressPattern();
+
+    int type;
+    switch(ofxSCAddressHash(address)){
+        case ofxSCAddressHash("/n_go"): type = OFXSC_REPLY_NODE_GO; break;
+        case ofxSCAddressHash("/n_end"): type = OFXSC_REPLY_NODE_END; break;
+        case ofxSCAddressHash("/n_off"): type = OFXSC_REPLY_NODE_OFF; break;
+        case ofxSCAddressHash("/n_on"): type = OFXSC_REPLY_NODE_ON; break;
+        case ofxSCAddressHash("/n_move"): type = OFXSC_REPLY_NODE_MOVE; break;
+        case ofxSCAddressHash("/tr"): type = OFXSC_REPLY_TRIGGER; break;
+        case ofxSCAddressHash("/c_set"): type = OFXSC_REPLY_CONTROL_SET; break;
+        case ofxSCAddressHash("/b_info"): type = OFXSC_REPLY_BUFFER_INFO; break;
+        case ofxSCAddressHash("/synced"): type = OFXSC_REPLY_SYNCED; break;
+        case ofxSCAddressHash("/done"): type = OFXSC_REPLY_DONE; break;
+        default: return -1;
+    }
+    // guard against a foreign address with the same hash
+    if(std::strcmp(address, replyAddresses[type]) != 0) return -1;
+    if(maxEvents < 1) return -1;
+
+    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+    osc::ReceivedMessage::const_iterator end = m.ArgumentsEnd();
+
+    switch(type){
+        case OFXSC_REPLY_NODE_GO:
+        case OFXSC_REPLY_NODE_END:
+        case OFXSC_REPLY_NODE_OFF:
+        case OFXSC_REPLY_NODE_ON:
+        case OFXSC_REPLY_NODE_MOVE:
+        case OFXSC_REPLY_SYNCED: {
+            ofxSCReplyEvent &e = newEvent(events, 0, (ofxSCReplyType)type);
+            for(; arg != end; ++arg){
+                if(!arg->IsInt32() || e.numArgs == ofxSCReplyEvent::maxArgs) return -1;
+                e.args[e.numArgs++] = arg->AsInt32Unchecked();
+            }
+            return e.numArgs > 0 ? 1 : -1;
+        }
+        case OFXSC_REPLY_TRIGGER: {
+            ofxSCReplyEvent &e = newEvent(events, 0, OFXSC_REPLY_TRIGGER);
+            for(; e.numArgs < 2; ++arg){
+                if(arg == end || !arg->IsInt32()) return -1;
+                e.args[e.numArgs++] = arg->AsInt32Unchecked();
+            }
+            if(arg == end || !arg->IsFloat()) return -1;
+            e.value = arg->AsFloatUnchecked();
+            return 1;
+        }
+        case OFXSC_REPLY_CONTROL_SET: {
+            int n = 0;
+            int32_t firstIndex = 0;
+            while(arg != end){
+                if(n == maxEvents || !arg->IsInt32()) return -1;
+                ofxSCReplyEvent &e = newEvent(events, n, OFXSC_REPLY_CONTROL_SET);
+                e.args[0] = arg->AsInt32Unchecked();
+                ++arg;
+                if(n == 0) firstIndex = e.args[0];
+                e.args[1] = firstIndex;
+                e.numArgs = 2;
+                if(arg == end || !arg->IsFloat()) return -1;
+                e.value = arg->AsFloatUnchecked();
+                ++arg;
+                n++;
+            }
+            return n > 0 ? n : -1;
+        }
+        case OFXSC_REPLY_BUFFER_INFO: {
+            int n = 0;
+            while(arg != end){
+                if(n == maxEvents) return -1;
+                ofxSCReplyEvent &e = newEvent(events, n, OFXSC_REPLY_BUFFER_INFO);
+                for(; e.numArgs < 3; ++arg){
+                    if(arg == end || !arg->IsInt32()) return -1;
+                    e.args[e.numArgs++] = arg->AsInt32Unchecked();
+                }
+                if(arg == end || !arg->IsFloat()) return -1;
+                e.value = arg->AsFloatUnchecked();
+                ++arg;
+                n++;
+            }
+            return n > 0 ? n : -1;
+        }
+        case OFXSC_REPLY_DONE: {
+            ofxSCReplyEvent &e = newEvent(events, 0, OFXSC_REPLY_DONE);
+            if(arg == end || !arg->IsString()) return -1;
+            const char *command = arg->AsStringUnchecked();
+            ++arg;
+            if(std::strlen(command) >= ofxSCReplyEvent::maxCommandLength) return -1;
+            std::strcpy(e.command, command);
+            for(; arg != end; ++arg){
+                if(!arg->IsInt32() || e.numArgs == ofxSCReplyEvent::maxArgs) return -1;
+                e.args[e.numArgs++] = arg->AsInt32Unchecked();
+            }
+            return 1;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,76 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "OscReceivedElements.h"
+#include "ofxOscMessage.h"
+
+/// FNV-1a hash of an OSC address, used to key the reply handler table
+constexpr uint32_t ofxSCAddressHash(const char *address){
+    uint32_t hash = 2166136261u;
+    while(*address != 0) hash = (hash ^ (uint8_t)*address++) * 16777619u;
+    return hash;
+}
+
+/// scsynth replies with a fixed shape, decoded without going through ofxOscMessage
+enum ofxSCReplyType
+{
+    OFXSC_REPLY_NODE_GO = 0,    ///< args: nodeID, parent, previous, next, isGroup [, head, tail]
+    OFXSC_REPLY_NODE_END,       ///< same as /n_go
+    OFXSC_REPLY_NODE_OFF,       ///< same as /n_go
+    OFXSC_REPLY_NODE_ON,        ///< same as /n_go
+    OFXSC_REPLY_NODE_MOVE,      ///< same as /n_go
+    OFXSC_REPLY_TRIGGER,        ///< /tr args: nodeID, triggerID, value: trigger value
+    OFXSC_REPLY_CONTROL_SET,    ///< /c_set, one event per pair. args: index, first index in the message, value: bus value
+    OFXSC_REPLY_BUFFER_INFO,    ///< /b_info, one event per buffer. args: bufnum, frames, channels, value: sample rate
+    OFXSC_REPLY_SYNCED,         ///< args: sync id
+    OFXSC_REPLY_DONE,           ///< command: completed command, args: optional index (e.g. bufnum)
+    OFXSC_REPLY_NUM_TYPES
+};
+
+/// A decoded reply. Plain data, copied around without allocating.
+struct ofxSCReplyEvent
+{
+    static const int maxArgs = 7;
+    static const int maxCommandLength = 32;
+
+    ofxSCReplyType type;
+    int32_t numArgs;
+    int32_t args[maxArgs];
+    float value;
+    char command[maxCommandLength];
+
+    /// \return the OSC address this event was decoded from
+    const char *getAddress() const;
+
+    /// rebuild the equivalent ofxOscMessage, for handlers that want one
+    void toMessage(ofxOscMessage &m) const;
+};
+
+/// One thing received from the server: a decoded event, or the message as it
+/// came if it has no fixed shape. Both kinds share a queue to keep the order
+/// scsynth sent them in.
+struct ofxSCReceivedReply
+{
+    bool decoded = false;
+    ofxSCReplyEvent event;
+    ofxOscMessage message;
+};
+
+/// Decode m into at most maxEvents events.
+/// \return number of events written, or -1 if m is not one of ofxSCReplyType
+/// or its arguments don't have the expected types
+int ofxSCDecodeReply(const osc::ReceivedMessage &m, ofxSCReplyEvent *events, int maxEvents);
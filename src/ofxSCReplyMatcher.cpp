@@ -0,0 +1,157 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCReplyMatcher.h"
+#include "ofxSCReplyEvent.h"
+
+#include <algorithm>
+
+//--------------------------------------------------------------
+ofxSCReplyMatcher::ofxSCReplyMatcher() : count(0)
+{
+}
+
+//--------------------------------------------------------------
+uint64_t ofxSCReplyMatcher::makeKey(const std::string &replyAddress, int key)
+{
+    return ((uint64_t)ofxSCAddressHash(replyAddress.c_str()) << 32) | (uint32_t)key;
+}
+
+//--------------------------------------------------------------
+std::shared_future<ofxSCReply> ofxSCReplyMatcher::expect(const std::string &command, const std::string &replyAddress, int key, int numArgs, ofxSCReplyCallback callback, TimePoint deadline)
+{
+    auto request = std::make_shared<Request>();
+    request->command = command;
+    request->key = makeKey(replyAddress, key);
+    request->numArgs = numArgs;
+    request->reply.message.setAddress(replyAddress);
+    request->callback = callback;
+    request->deadline = deadline;
+    std::shared_future<ofxSCReply> future = request->promise.get_future().share();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    waiting[request->key].push_back(request);
+    byTime.push_back(request);
+    count++;
+    return future;
+}
+
+//--------------------------------------------------------------
+static void appendArgs(ofxOscMessage &to, const ofxOscMessage &from)
+{
+    for(size_t i = 0; i < from.getNumArgs(); i++){
+        switch(from.getArgType(i)){
+            case OFXOSC_TYPE_INT32: to.addIntArg(from.getArgAsInt32(i)); break;
+            case OFXOSC_TYPE_INT64: to.addInt64Arg(from.getArgAsInt64(i)); break;
+            case OFXOSC_TYPE_FLOAT: to.addFloatArg(from.getArgAsFloat(i)); break;
+            case OFXOSC_TYPE_DOUBLE: to.addDoubleArg(from.getArgAsDouble(i)); break;
+            case OFXOSC_TYPE_STRING:
+            case OFXOSC_TYPE_SYMBOL: to.addStringArg(from.getArgAsString(i)); break;
+            default: break;     // scsynth doesn't reply with anything else
+        }
+    }
+}
+
+bool ofxSCReplyMatcher::match(const std::string &replyAddress, int key, const ofxOscMessage &m)
+{
+    RequestPtr finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = waiting.find(makeKey(replyAddress, key));
+        if(it == waiting.end() || it->second.empty()) return false;
+
+        RequestPtr request = it->second.front();
+        appendArgs(request->reply.message, m);
+        if((int)request->reply.message.getNumArgs() < request->numArgs) return true;
+
+        request->reply.ok = true;
+        remove(request);
+        finished = request;
+    }
+    complete(finished);
+    return true;
+}
+
+//--------------------------------------------------------------
+bool ofxSCReplyMatcher::fail(const std::string &command, const std::string &error)
+{
+    RequestPtr failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find_if(byTime.begin(), byTime.end(), [&](const RequestPtr &r){ return !r->done && r->command == command; });
+        if(it == byTime.end()) return false;
+        failed = *it;
+        failed->reply.error = error;
+        remove(failed);
+    }
+    complete(failed);
+    return true;
+}
+
+//--------------------------------------------------------------
+void ofxSCReplyMatcher::expire(TimePoint now)
+{
+    if(empty()) return;
+
+    std::vector<RequestPtr> expired;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // deadlines come in order as long as the timeout doesn't change
+        while(!byTime.empty() && (byTime.front()->done || byTime.front()->deadline <= now)){
+            RequestPtr request = byTime.front();
+            byTime.pop_front();
+            if(request->done) continue;
+            request->reply.error = "timeout";
+            remove(request);
+            expired.push_back(request);
+        }
+    }
+    for(auto &request : expired) complete(request);
+}
+
+//--------------------------------------------------------------
+ofxSCReplyMatcher::TimePoint ofxSCReplyMatcher::getNextDeadline() const
+{
+    if(empty()) return TimePoint::max();
+    std::lock_guard<std::mutex> lock(mutex);
+    // completed requests at the front are popped by remove(), and deadlines are in order, see expire()
+    return byTime.empty() ? TimePoint::max() : byTime.front()->deadline;
+}
+
+//--------------------------------------------------------------
+size_t ofxSCReplyMatcher::size() const
+{
+    return count;
+}
+
+//--------------------------------------------------------------
+void ofxSCReplyMatcher::remove(const RequestPtr &request)
+{
+    request->done = true;
+    count--;
+    auto it = waiting.find(request->key);
+    if(it != waiting.end()){
+        auto &queue = it->second;
+        queue.erase(std::find(queue.begin(), queue.end(), request));
+        if(queue.empty()) waiting.erase(it);
+    }
+    // the rest of byTime lets go of completed requests once expire() gets that far
+    while(!byTime.empty() && byTime.front()->done) byTime.pop_front();
+}
+
+//--------------------------------------------------------------
+void ofxSCReplyMatcher::complete(const RequestPtr &request)
+{
+    if(request->callback) request->callback(request->reply);
+    request->promise.set_value(request->reply);
+}
@@ -0,0 +1,94 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "ofxOsc.h"
+
+/// the answer to a request sent through ofxSCServer
+struct ofxSCReply {
+    bool ok = false;            ///< false if the server sent /fail or nothing came back in time
+    ofxOscMessage message;      ///< the reply, args gathered from every message that answered
+    std::string error;          ///< the /fail error, or "timeout"
+};
+
+typedef std::function<void(const ofxSCReply&)> ofxSCReplyCallback;
+
+/// Requests waiting for their reply. A reply is matched by its address and a key
+/// argument (bufnum, first bus index, group id) to the oldest request waiting for
+/// both, and /fail by command to the oldest request for that command, since
+/// scsynth answers in the order it got the requests. Arguments are gathered until
+/// the request has all it asked for, so replies that come in pieces (/c_set
+/// through the fast path) complete it once.
+///
+/// Callbacks and futures are completed outside the lock, from whichever thread
+/// calls match(), fail() or expire(). Thread safe.
+class ofxSCReplyMatcher
+{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    ofxSCReplyMatcher();
+
+    /// wait for a reply to command on replyAddress carrying key
+    /// \param numArgs arguments needed to complete it, the first reply completes it if 0
+    std::shared_future<ofxSCReply> expect(const std::string &command, const std::string &replyAddress, int key, int numArgs, ofxSCReplyCallback callback, TimePoint deadline);
+
+    /// \return true if m answered a request
+    bool match(const std::string &replyAddress, int key, const ofxOscMessage &m);
+    /// complete the oldest request for command with error
+    /// \return true if one was waiting
+    bool fail(const std::string &command, const std::string &error);
+    /// fail every request whose deadline has passed
+    void expire(TimePoint now);
+    /// \return when expire() has something to do next, TimePoint::max() if nothing waits
+    TimePoint getNextDeadline() const;
+
+    size_t size() const;
+    /// without locking, to skip building messages when nothing waits
+    bool empty() const {return count == 0;};
+
+private:
+    struct Request{
+        std::string command;
+        uint64_t key;
+        int numArgs;
+        ofxSCReply reply;
+        std::promise<ofxSCReply> promise;
+        ofxSCReplyCallback callback;
+        TimePoint deadline;
+        bool done = false;
+    };
+    typedef std::shared_ptr<Request> RequestPtr;
+
+    static uint64_t makeKey(const std::string &replyAddress, int key);
+    /// take request out of the queues, with the lock held
+    void remove(const RequestPtr &request);
+    static void complete(const RequestPtr &request);
+
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, std::deque<RequestPtr>> waiting;     ///< by reply address and key, oldest first
+    std::deque<RequestPtr> byTime;      ///< in the order they were made, completed ones are skipped lazily
+    std::atomic<size_t> count;
+};
@@ -13,53 +13,209 @@
 
 #include "ofxSCResourceAllocator.h"
 
-ofxSCResourceAllocator::ofxSCResourceAllocator(int capacity)
+#include <algorithm>
+
+#include "ofLog.h"
+
+ofxSCResourceAllocator::ofxSCResourceAllocator(int capacity, int reserved)
+{
+	this->capacity = std::max(capacity, 0);
+	this->reserved = std::min(std::max(reserved, 0), this->capacity);
+	numFree = this->capacity - this->reserved;
+	numFreeBlocks = 0;
+	top = this->reserved;
+
+	std::fill(freeLists, freeLists + numLists, -1);
+	std::fill(subNonEmpty, subNonEmpty + numClasses, 0u);
+	nonEmpty = 0;
+
+	// the reserved indices are one block that is never freed
+	if (this->reserved > 0) {
+		grow(this->reserved);
+		setBlock(0, this->reserved, false);
+	}
+}
+
+int ofxSCResourceAllocator::floorLog2(uint32_t size)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return 31 - __builtin_clz(size);
+#else
+	int log = 0;
+	while (size >>= 1) log++;
+	return log;
+#endif
+}
+
+int ofxSCResourceAllocator::lowestBit(uint32_t bits)
 {
-	this->capacity = capacity;
-	this->pos = 0;
-	
-	this->resources.resize(capacity);
-	for (int i = 0; i < capacity; i++)
-		this->resources[i] = NULL;
-						
-	this->free_lists.resize(65536);
-	for (int i = 0; i < 65536; i++)
-		this->free_lists[i] = NULL;
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctz(bits);
+#else
+	int n = 0;
+	while (!(bits & (1u << n))) n++;
+	return n;
+#endif
 }
 
+int ofxSCResourceAllocator::listOf(int size)
+{
+	// the classes below numSubClasses have fewer sizes than sub-classes, one each
+	int sizeClass = floorLog2(size);
+	int subClass = sizeClass < subClassBits ? size - (1 << sizeClass)
+		: (size >> (sizeClass - subClassBits)) - numSubClasses;
+	return sizeClass * numSubClasses + subClass;
+}
 
-int ofxSCResourceAllocator::alloc (int resource_size)
+int ofxSCResourceAllocator::alloc (int size)
 {
-	ofxSCResource *res = free_lists[resource_size];
-	
-	// Resource of this size has previously been freed.
-	if (res != NULL)
-	{
-		free_lists[resource_size] = res->next;
-		return res->address;
+	if (size <= 0 || size > numFree) return -1;
+
+	// a block of the size's own list that fits leaves the bigger ones whole, but
+	// only a few are looked at before falling back to the next list with blocks,
+	// all of which fit
+	int list = listOf(size);
+	int address = findInList(list, size);
+	if (address == -1) {
+		int bigger = findListAfter(list);
+		if (bigger != -1)
+			address = freeLists[bigger];
 	}
-	
-	// Not got previously freed resource but some have yet to be allocated.
-	if ((pos + resource_size) <= capacity)
-	{
-		int address;
-		resources[pos] = new ofxSCResource(pos, resource_size);
-		address = pos;
-		pos += resource_size;
+
+	// then the space never handed out
+	if (address == -1) {
+		if (capacity - top < size) return -1;
+		address = top;
+		grow(top + size);
+		top += size;
+		setBlock(address, size, false);
+		numFree -= size;
 		return address;
 	}
-	
-	return -1;
+
+	int blockSize = -head[address];
+	removeFree(address, blockSize);
+	setBlock(address, size, false);
+	if (blockSize > size)
+		insertFree(address + size, blockSize - size);
+	return address;
 }
 
 void ofxSCResourceAllocator::free (int address)
 {
-	ofxSCResource *res = resources[address];
-	
-	if (res != NULL)
-	{
-		res->next = free_lists[res->size];
-		free_lists[res->size] = res;
-		// should we set resources[address] = null?
+	if (address < reserved || address >= top || head[address] <= 0) {
+		ofLogWarning("ofxSCResourceAllocator") << "free(): " << address << " isn't an allocated range";
+		return;
+	}
+
+	int size = head[address];
+	head[address] = 0;
+
+	// merge with the free neighbours
+	int next = address + size;
+	if (next < top && head[next] < 0) {
+		int nextSize = -head[next];
+		removeFree(next, nextSize);
+		head[next] = 0;
+		size += nextSize;
+	}
+	if (address > reserved) {
+		int previous = tail[address - 1];
+		if (head[previous] < 0) {
+			int previousSize = -head[previous];
+			removeFree(previous, previousSize);
+			address = previous;
+			size += previousSize;
+		}
+	}
+
+	// the last block goes back to the space never handed out
+	if (address + size == top) {
+		top = address;
+		numFree += size;
+		return;
+	}
+	insertFree(address, size);
+}
+
+int ofxSCResourceAllocator::findInList(int list, int size) const
+{
+	int scanned = 0;
+	for (int a = freeLists[list]; a != -1 && scanned < maxScan; a = nextFree[a], scanned++) {
+		if (-head[a] >= size) return a;
+	}
+	return -1;
+}
+
+int ofxSCResourceAllocator::findListAfter(int list) const
+{
+	int sizeClass = list / numSubClasses;
+	int subClass = list % numSubClasses;
+	uint32_t subFits = subNonEmpty[sizeClass] & (~0u << (subClass + 1));
+	if (subFits != 0)
+		return sizeClass * numSubClasses + lowestBit(subFits);
+	uint32_t fits = sizeClass + 1 < numClasses ? nonEmpty & (~0u << (sizeClass + 1)) : 0;
+	if (fits == 0) return -1;
+	sizeClass = lowestBit(fits);
+	return sizeClass * numSubClasses + lowestBit(subNonEmpty[sizeClass]);
+}
+
+int ofxSCResourceAllocator::getLargestFree() const
+{
+	int largest = capacity - top;
+	if (nonEmpty == 0) return largest;
+	int largestClass = floorLog2(nonEmpty);
+	int largestList = largestClass * numSubClasses + floorLog2(subNonEmpty[largestClass]);
+	for (int a = freeLists[largestList]; a != -1; a = nextFree[a])
+		largest = std::max(largest, -head[a]);
+	return largest;
+}
+
+void ofxSCResourceAllocator::grow(int end)
+{
+	int size = (int)head.size();
+	if (end <= size) return;
+	size = std::min(capacity, std::max(end, std::max(size * 2, 64)));
+	head.resize(size, 0);
+	tail.resize(size, 0);
+	nextFree.resize(size, -1);
+	prevFree.resize(size, -1);
+}
+
+void ofxSCResourceAllocator::setBlock(int address, int size, bool isFree)
+{
+	head[address] = isFree ? -size : size;
+	tail[address + size - 1] = address;
+}
+
+void ofxSCResourceAllocator::insertFree(int address, int size)
+{
+	setBlock(address, size, true);
+	int list = listOf(size);
+	int first = freeLists[list];
+	nextFree[address] = first;
+	prevFree[address] = -1;
+	if (first != -1) prevFree[first] = address;
+	freeLists[list] = address;
+	subNonEmpty[list / numSubClasses] |= 1u << (list % numSubClasses);
+	nonEmpty |= 1u << (list / numSubClasses);
+	numFree += size;
+	numFreeBlocks++;
+}
+
+void ofxSCResourceAllocator::removeFree(int address, int size)
+{
+	int list = listOf(size);
+	int next = nextFree[address];
+	int previous = prevFree[address];
+	if (previous != -1) nextFree[previous] = next;
+	else freeLists[list] = next;
+	if (next != -1) prevFree[next] = previous;
+	if (freeLists[list] == -1) {
+		int sizeClass = list / numSubClasses;
+		subNonEmpty[sizeClass] &= ~(1u << (list % numSubClasses));
+		if (subNonEmpty[sizeClass] == 0) nonEmpty &= ~(1u << sizeClass);
 	}
+	numFree -= size;
+	numFreeBlocks--;
 }
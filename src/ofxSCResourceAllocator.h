@@ -14,36 +14,88 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 
-class ofxSCResource
-{
-
-public:
-	
-	ofxSCResource(int address, int size)
-	{
-		this->address = address;
-		this->size = size;
-		this->next = NULL;
-	}
-	
-	int address;
-	int size;
-	
-	// pointer to next resource in free list
-	ofxSCResource *next;	
-};
-
+/// Hands out ranges of consecutive indices (busses, buffers). Freed ranges
+/// merge with free neighbours and big ones are split for small requests, so
+/// a freed 8 channel bus can serve two 4 channel ones.
+///
+/// Every block has boundary tags in flat arrays indexed by address: its size
+/// at its first index, its start at its last, so a freed block finds both
+/// neighbours in O(1). Free blocks sit in doubly linked lists as in TLSF: one
+/// per power of two size class, split in eight sub-classes, with bitmaps of
+/// the non-empty ones. alloc() looks at a few blocks of the request's own
+/// list, which keeps big ranges whole, then takes the first block of the next
+/// non-empty list, which always fits, found with two bit scans. Both alloc()
+/// and free() are O(1); the price is that alloc() can return -1 while a block
+/// that fits is still in the request's own list, past the first few. With
+/// eight sub-classes that takes a list of near misses, each within 1/8 of the
+/// request.
+///
+/// Indices past the highest one ever handed out are free without being in a
+/// list, and the tag arrays only grow to that high water mark, so a 65536
+/// entry allocator costs next to nothing until it is used.
+///
+/// This replaced the bump pointer and single free list whose public pos,
+/// resources and free_lists members (and the ofxSCResource blocks in them)
+/// are gone; getHighWater(), getNumFree() and getNumFreeBlocks() tell what
+/// they did. Constructing with just a capacity works as before.
 class ofxSCResourceAllocator
 {
 public:
-	ofxSCResourceAllocator(int capacity);
-	
-	int alloc (int resource_size);
+	/// \param reserved indices at the start never handed out, e.g. the hardware busses
+	ofxSCResourceAllocator(int capacity, int reserved = 0);
+
+	/// \return the first index of size consecutive ones, -1 if there is no room
+	int alloc (int size);
+	/// give back a range returned by alloc()
 	void free (int address);
-	
+
+	int getCapacity() const {return capacity;};
+	int getReserved() const {return reserved;};
+	/// \return indices not allocated, reserved ones excluded
+	int getNumFree() const {return numFree;};
+	/// \return the biggest range alloc() can return right now
+	int getLargestFree() const;
+	int getNumFreeBlocks() const {return numFreeBlocks + (top < capacity ? 1 : 0);};
+	/// \return one past the highest index handed out so far, what the tags take memory for
+	int getHighWater() const {return top;};
+
+private:
+	static const int numClasses = 32;
+	static const int subClassBits = 3;
+	static const int numSubClasses = 1 << subClassBits;
+	static const int numLists = numClasses * numSubClasses;
+	/// blocks of the request's own list looked at before taking a bigger one
+	static const int maxScan = 8;
+
+	/// of a non zero value
+	static int floorLog2(uint32_t size);
+	static int lowestBit(uint32_t bits);
+	/// \return the list free blocks of size go in
+	static int listOf(int size);
+	/// \return the first of at most maxScan blocks of list with room for size, -1 if none
+	int findInList(int list, int size) const;
+	/// \return the first non-empty list after list, -1 if none
+	int findListAfter(int list) const;
+	/// make room in the tag arrays for indices below end
+	void grow(int end);
+	void insertFree(int address, int size);
+	void removeFree(int address, int size);
+	/// write the tags of a block
+	void setBlock(int address, int size, bool isFree);
+
 	int capacity;
-	int pos;
-	std::vector <ofxSCResource *> resources;
-	std::vector <ofxSCResource *> free_lists;
-};
\ No newline at end of file
+	int reserved;
+	int numFree;
+	int numFreeBlocks;				///< in the lists, the space from top on isn't one of them
+	int top;						///< indices from here to capacity were never handed out
+
+	std::vector<int32_t> head;		///< at a block's first index below top: its size, negative if free, 0 elsewhere
+	std::vector<int32_t> tail;		///< at a block's last index: its first index
+	std::vector<int32_t> nextFree;	///< free list links, at a free block's first index
+	std::vector<int32_t> prevFree;
+	int32_t freeLists[numLists];	///< first block of each list, sub-class fastest, -1 if empty
+	uint32_t nonEmpty;				///< bit n set if size class n has a non-empty list
+	uint32_t subNonEmpty[numClasses];	///< bit m set if sub-class m of the class has a block
+};
@@ -0,0 +1,229 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+/// what push() does when the queue is full
+enum ofxSCOverflowPolicy
+{
+    OFXSC_DROP_NEWEST = 0,  ///< keep what is queued, discard the element being pushed
+    OFXSC_DROP_OLDEST       ///< discard the oldest queued element to make room
+};
+
+/// Bounded lock-free queue used to hand messages between threads.
+/// Every slot carries a sequence number (Dmitry Vyukov's bounded queue), so
+/// push and pop never take a lock. The slots are allocated by the first
+/// push(), or by reserve(), so a queue that is never used costs nothing;
+/// after that nothing allocates. A real-time producer calls reserve() first.
+/// Safe with any number of producers and consumers, which every queue here
+/// needs: sends, real-time packets and freed node ids come from any thread,
+/// and even the received message queues, filled by one listener thread, have
+/// two consumers, since push() with OFXSC_DROP_OLDEST pops on the listener
+/// while the thread running process() drains. That costs a compare-and-swap
+/// per push and pop, drain() claims whole runs with one. The indices, the
+/// overflow counter and every slot sit on their own cache lines, so a slot
+/// being written doesn't invalidate the one next to it being read, unless
+/// padded is false for a queue too cold to be worth the memory.
+template<typename T, bool padded = true>
+class ofxSCRingBuffer
+{
+public:
+    static constexpr size_t cacheLineSize = 64;
+
+    /// capacity is rounded up to the next power of two
+    explicit ofxSCRingBuffer(size_t capacity = 1024)
+    {
+        size_t size = 2;
+        while(size < capacity) size <<= 1;
+        mask = size - 1;
+        cells.store(nullptr, std::memory_order_relaxed);
+        enqueuePos.store(0, std::memory_order_relaxed);
+        dequeuePos.store(0, std::memory_order_relaxed);
+        overflows.store(0, std::memory_order_relaxed);
+    }
+
+    ~ofxSCRingBuffer()
+    {
+        delete[] cells.load(std::memory_order_acquire);
+    }
+
+    ofxSCRingBuffer(const ofxSCRingBuffer&) = delete;
+    ofxSCRingBuffer& operator=(const ofxSCRingBuffer&) = delete;
+
+    /// allocate the slots now instead of in the first push(). Thread safe
+    void reserve()
+    {
+        getCells();
+    }
+
+    /// move value into the queue
+    /// \return false if the queue is full, value is left untouched then
+    bool push(T &value)
+    {
+        Cell *cells = getCells();
+        Cell *cell;
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for(;;){
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if(dif == 0){
+                if(enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }else if(dif < 0){
+                return false;
+            }else{
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// move value into the queue, applying policy if it is full.
+    /// Every element dropped, new or old, is counted in getNumOverflows()
+    /// \return false if value was dropped
+    bool push(T &value, ofxSCOverflowPolicy policy)
+    {
+        while(!push(value)){
+            overflows.fetch_add(1, std::memory_order_relaxed);
+            if(policy == OFXSC_DROP_NEWEST) return false;
+            T oldest;
+            pop(oldest);
+        }
+        return true;
+    }
+
+    /// move the oldest element into value
+    /// \return false if the queue is empty
+    bool pop(T &value)
+    {
+        Cell *cells = this->cells.load(std::memory_order_acquire);
+        if(!cells) return false;
+        Cell *cell;
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        for(;;){
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(dif == 0){
+                if(dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }else if(dif < 0){
+                return false;
+            }else{
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->value);
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// call fn(T&) on up to max elements, oldest first. Ready elements are claimed
+    /// in runs with a single atomic operation instead of one per element. Each one
+    /// is moved out and its slot released before fn sees it, so fn may push. If fn
+    /// throws, the rest of the run claimed with that element is discarded and the
+    /// exception passes on, the queue stays usable.
+    /// \return number of elements consumed
+    template<typename F>
+    size_t drain(F &&fn, size_t max = std::numeric_limits<size_t>::max())
+    {
+        Cell *cells = this->cells.load(std::memory_order_acquire);
+        if(!cells) return 0;
+        size_t total = 0;
+        while(total < max){
+            size_t pos = dequeuePos.load(std::memory_order_relaxed);
+            size_t limit = std::min(max - total, capacity());
+            size_t n = 0;
+            while(n < limit && cells[(pos + n) & mask].sequence.load(std::memory_order_acquire) == pos + n + 1) n++;
+            if(n == 0) break;
+            if(!dequeuePos.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) continue;
+            
+            // hands the claimed slots back to the producers, also when fn throws
+            struct Release{
+                Cell *cells;
+                size_t mask, pos, i, n;
+                ~Release(){
+                    for(; i < n; i++){
+                        Cell &cell = cells[(pos + i) & mask];
+                        cell.value = T();
+                        cell.sequence.store(pos + i + mask + 1, std::memory_order_release);
+                    }
+                }
+            } release{cells, mask, pos, 0, n};
+            while(release.i < n){
+                Cell &cell = cells[(pos + release.i) & mask];
+                T value = std::move(cell.value);
+                cell.sequence.store(pos + release.i + mask + 1, std::memory_order_release);
+                release.i++;
+                fn(value);
+            }
+            total += n;
+        }
+        return total;
+    }
+
+    /// \return number of elements dropped by push(value, policy) because the queue was full
+    uint64_t getNumOverflows() const
+    {
+        return overflows.load(std::memory_order_relaxed);
+    }
+
+    /// \return approximate number of elements, exact when called with no concurrent push/pop
+    size_t size() const
+    {
+        size_t enqueued = enqueuePos.load(std::memory_order_acquire);
+        size_t dequeued = dequeuePos.load(std::memory_order_acquire);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+private:
+    struct alignas(padded ? cacheLineSize : alignof(std::atomic<size_t>)) Cell{
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    Cell *getCells()
+    {
+        Cell *current = cells.load(std::memory_order_acquire);
+        if(current) return current;
+        size_t size = mask + 1;
+        Cell *allocated = new Cell[size];
+        for(size_t i = 0; i < size; i++) allocated[i].sequence.store(i, std::memory_order_relaxed);
+        // two first pushes at once: the loser's slots go again
+        if(cells.compare_exchange_strong(current, allocated, std::memory_order_acq_rel, std::memory_order_acquire)) return allocated;
+        delete[] allocated;
+        return current;
+    }
+
+    std::atomic<Cell*> cells;
+    size_t mask;
+    alignas(cacheLineSize) std::atomic<size_t> enqueuePos;
+    alignas(cacheLineSize) std::atomic<size_t> dequeuePos;
+    alignas(cacheLineSize) std::atomic<uint64_t> overflows;
+};
@@ -0,0 +1,188 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCScheduler.h"
+
+#include <algorithm>
+#include <climits>
+
+//--------------------------------------------------------------
+ofxSCScheduler::ofxSCScheduler() : numCancelled(0), nextOrder(0), nextID(0), wakeup(nullptr)
+{
+    setLookahead(0.1);
+}
+
+//--------------------------------------------------------------
+int ofxSCScheduler::schedule(TimePoint time, const ofxOscBundle &bundle)
+{
+    Event event;
+    event.time = time;
+    event.bundle = bundle;
+    return push(event);
+}
+
+//--------------------------------------------------------------
+int ofxSCScheduler::schedule(TimePoint time, const ofxOscMessage &message)
+{
+    Event event;
+    event.time = time;
+    event.bundle.addMessage(message);
+    return push(event);
+}
+
+//--------------------------------------------------------------
+int ofxSCScheduler::schedule(TimePoint time, EventFunction function)
+{
+    Event event;
+    event.time = time;
+    event.function = function;
+    return push(event);
+}
+
+//--------------------------------------------------------------
+static ofxSCScheduler::TimePoint fromNow(double seconds)
+{
+    return std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+}
+
+int ofxSCScheduler::scheduleIn(double seconds, const ofxOscBundle &bundle)
+{
+    return schedule(fromNow(seconds), bundle);
+}
+
+int ofxSCScheduler::scheduleIn(double seconds, const ofxOscMessage &message)
+{
+    return schedule(fromNow(seconds), message);
+}
+
+int ofxSCScheduler::scheduleIn(double seconds, EventFunction function)
+{
+    return schedule(fromNow(seconds), function);
+}
+
+//--------------------------------------------------------------
+int ofxSCScheduler::push(Event &event)
+{
+    int id;
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = nextID;
+        nextID = nextID == INT_MAX ? 0 : nextID + 1;
+        event.id = id;
+        event.order = nextOrder++;
+        events.push_back(std::move(event));
+        std::push_heap(events.begin(), events.end(), std::greater<Event>());
+        first = events.front().id == id;
+    }
+    // whoever sleeps until the next event has to look again
+    if(first && wakeup != nullptr) wakeup->wake();
+    return id;
+}
+
+//--------------------------------------------------------------
+bool ofxSCScheduler::cancel(int eventID)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    // marked rather than removed, the heap stays as it is
+    for(auto &event : events){
+        if(event.id == eventID && !event.cancelled){
+            event.cancelled = true;
+            event.bundle.clear();
+            event.function = nullptr;
+            numCancelled++;
+            popCancelled();
+            return true;
+        }
+    }
+    return false;
+}
+
+//--------------------------------------------------------------
+void ofxSCScheduler::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    events.clear();
+    numCancelled = 0;
+}
+
+//--------------------------------------------------------------
+size_t ofxSCScheduler::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return events.size() - numCancelled;
+}
+
+//--------------------------------------------------------------
+void ofxSCScheduler::setLookahead(double seconds)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        lookahead = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+    }
+    if(wakeup != nullptr) wakeup->wake();
+}
+
+//--------------------------------------------------------------
+double ofxSCScheduler::getLookahead() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::chrono::duration<double>(lookahead).count();
+}
+
+//--------------------------------------------------------------
+void ofxSCScheduler::popCancelled()
+{
+    while(!events.empty() && events.front().cancelled){
+        std::pop_heap(events.begin(), events.end(), std::greater<Event>());
+        events.pop_back();
+        numCancelled--;
+    }
+}
+
+//--------------------------------------------------------------
+void ofxSCScheduler::update(TimePoint now, const SendFunction &send)
+{
+    std::vector<Event> due;
+    while(true){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            TimePoint horizon = now + lookahead;
+            while(!events.empty() && events.front().time <= horizon){
+                std::pop_heap(events.begin(), events.end(), std::greater<Event>());
+                if(events.back().cancelled) numCancelled--;
+                else due.push_back(std::move(events.back()));
+                events.pop_back();
+            }
+        }
+        if(due.empty()) return;
+        
+        // unlocked, functions may schedule more, which is picked up by the next round
+        for(auto &event : due){
+            if(event.function) event.function(event.bundle, event.time);
+            if(event.bundle.getMessageCount() > 0 || event.bundle.getBundleCount() > 0){
+                send(event.bundle, event.time);
+            }
+        }
+        due.clear();
+    }
+}
+
+//--------------------------------------------------------------
+ofxSCScheduler::TimePoint ofxSCScheduler::getNextUpdate() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(events.empty()) return TimePoint::max();
+    // the top is never a cancelled event, see popCancelled()
+    return events.front().time - lookahead;
+}
@@ -0,0 +1,95 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <functional>
+
+#include "ofxOsc.h"
+#include "ofxSCWakeup.h"
+
+/// Time-ordered queue of bundles for the server. Events are kept in a heap on
+/// their due time and handed out once they enter the lookahead window, so
+/// they can be sent ahead with a timetag for exactly that time and scsynth
+/// plays them sample accurately, however late the sending thread wakes up.
+///
+/// ofxSCServer owns one (getScheduler()) and drains it every process(), on
+/// the I/O thread if it runs, so the lookahead should be longer than the time
+/// between two process() calls. Thread safe.
+class ofxSCScheduler
+{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    /// fills the bundle sent for the event, called when it enters the lookahead
+    /// window with its due time. May schedule further events
+    typedef std::function<void(ofxOscBundle &bundle, TimePoint time)> EventFunction;
+    /// receives each due event with the time its timetag should carry
+    typedef std::function<void(const ofxOscBundle &bundle, TimePoint time)> SendFunction;
+
+    ofxSCScheduler();
+
+    /// \return an id for cancel()
+    int schedule(TimePoint time, const ofxOscBundle &bundle);
+    int schedule(TimePoint time, const ofxOscMessage &message);
+    int schedule(TimePoint time, EventFunction function);
+    /// same, seconds from now
+    int scheduleIn(double seconds, const ofxOscBundle &bundle);
+    int scheduleIn(double seconds, const ofxOscMessage &message);
+    int scheduleIn(double seconds, EventFunction function);
+
+    /// \return false if the event was already sent or cancelled
+    bool cancel(int eventID);
+    void clear();
+    /// \return events waiting to be sent
+    size_t size() const;
+
+    /// seconds before its due time an event is sent, 0.1 by default
+    void setLookahead(double seconds);
+    double getLookahead() const;
+
+    /// pass every event due before now plus the lookahead to send, in time order.
+    /// Events scheduled from an EventFunction that are already due go out in the same call
+    void update(TimePoint now, const SendFunction &send);
+    /// \return when the next event enters the lookahead window, TimePoint::max() if there is none
+    TimePoint getNextUpdate() const;
+    /// woken when getNextUpdate() moves earlier, set before scheduling. Not owned
+    void setWakeup(ofxSCWakeup *wakeup){this->wakeup = wakeup;};
+
+private:
+    struct Event{
+        TimePoint time;
+        uint64_t order;             ///< events due at the same time go out in the order they were scheduled
+        int id;
+        ofxOscBundle bundle;
+        EventFunction function;
+        bool cancelled = false;
+        bool operator>(const Event &other) const {
+            return time > other.time || (time == other.time && order > other.order);
+        }
+    };
+
+    int push(Event &event);
+    /// drop cancelled events from the top of the heap
+    void popCancelled();
+
+    mutable std::mutex mutex;
+    std::vector<Event> events;      ///< min-heap on time
+    size_t numCancelled;
+    uint64_t nextOrder;
+    int nextID;
+    std::chrono::steady_clock::duration lookahead;
+    ofxSCWakeup *wakeup;
+};
@@ -16,44 +16,123 @@
 #include "ofxOsc.h"
 #include "ofxSCNode.h"
 
-#define MILISECONDS_FROM_1900_to_1970 2208988800000ULL
-#define TWO_TO_THE_32_OVER_ONE_MILLION 4295
+#include <algorithm>
+#include <climits>
+#include <iterator>
 
 #define INTIALIZATION_ID 1917  //Init with numbers
+// how long a send from another thread waits for room in a full queue
+#define OUTBOUND_WAIT_MS 100
+// sync barrier ids count up from here, clear of INTIALIZATION_ID and ids apps pick by hand
+#define SYNC_BARRIER_BASE_ID 0x40000000
+
+#define MAX_UDP_PAYLOAD 65507
+#define IP_UDP_HEADER_SIZE 28
+// smallest MTU every IPv4 link carries
+#define MIN_PATH_MTU 68
+// "#bundle\0" and the timetag
+#define BUNDLE_HEADER_SIZE 16
+// every bundle element is prefixed by its size
+#define BUNDLE_ELEMENT_SIZE 4
+// a bundle goes out as the one element of a timetagged one
+#define NESTED_BUNDLE_OVERHEAD (BUNDLE_HEADER_SIZE + BUNDLE_ELEMENT_SIZE)
 
 ofxSCServer *ofxSCServer::plocal = NULL;
+std::atomic<uint64_t> ofxSCServer::nextUID(1);
 
-ofxSCServer::ofxSCServer(std::string hostname, unsigned int port, unsigned int receivePort, unsigned int numInputs, unsigned int numOutputs, unsigned int numAudioBusses, unsigned int numControlBusses, unsigned int numBuffers)
+ofxSCServer::ofxSCServer(std::string hostname, unsigned int port, unsigned int receivePort, unsigned int numInputs, unsigned int numOutputs, unsigned int numAudioBusses, unsigned int numControlBusses, unsigned int numBuffers) : waitToSend(false), nextStagingOrder(0), uid(nextUID++), nodeIDs(std::max(1, ofxSCNode::id_base.load())), realtimeSender(nodeIDs), syncBarrierPending(false), nextSyncBarrierID(SYNC_BARRIER_BASE_ID), syncTimeout(5), outbound(4096), droppedSends(0), outboundStalled(false), ioThreadRunning(false), ioThreadStopping(false), ownerThreadID(std::this_thread::get_id())
 {
 	this->hostname = hostname;
 	this->port = port;
 
-    osc.setup(hostname, port, receivePort);
+    ofxOscSenderReceiverSettings settings;
+    settings.host = hostname;
+    settings.outPort = port;
+    settings.inPort = receivePort;
+    settings.decodeReplies = true;
+    settings.nativeSocket = true;
+    osc.setWakeup(&ioWakeup);
+    osc.setup(settings);
+    realtimeSender.setWakeup(&ioWakeup);
+    scheduler.setWakeup(&ioWakeup);
     listener = ofEvents().update.newListener(this, &ofxSCServer::_process);
 	
-	allocatorBusAudio = new ofxSCResourceAllocator(numAudioBusses);
-	allocatorBusAudio->pos = numInputs + numOutputs;
+	// the hardware inputs and outputs come first
+	allocatorBusAudio = new ofxSCResourceAllocator(numAudioBusses, numInputs + numOutputs);
 	
 	allocatorBusControl = new ofxSCResourceAllocator(numControlBusses);
 	allocatorBuffer = new ofxSCResourceAllocator(numBuffers);
-    
-    audioBusses.resize(numAudioBusses);
-    controlBusses.resize(numControlBusses);
-    buffers.resize(numBuffers);
 	
 	if (plocal == 0)
 		plocal = this;
     
-    waitToSend = false;
+    maxDatagramSize = MAX_UDP_PAYLOAD;
     
     latency = 0.2;
     b_latency = false;
     
+    coalescing = false;
+    
     initializing = false;
+    
+    statusInterval = statusPollSettings.bootInterval;
+    statusPending = false;
+    responding = false;
+    
+    // replies that scsynth sends with a fixed shape arrive as ofxSCReplyEvent,
+    // the handlers below only see them if the fast path can't decode them
+    nextReplyHandlerID = 0;
+    requestTimeout = 2;
+    addBuiltinReplyHandler("/status.reply", [this](ofxOscMessage &m){ handleStatusReply(m); });
+    addBuiltinReplyHandler("/synced", [this](ofxOscMessage &m){ handleSynced(m.getArgAsInt(0)); });
+    addBuiltinReplyHandler("/b_info", [this](ofxOscMessage &m){
+        for(int i = 0; i + 3 < m.getNumArgs(); i+=4){
+            handleBufferInfo(m.getArgAsInt32(i), m.getArgAsInt32(i+1), m.getArgAsInt32(i+2), m.getArgAsFloat(i+3));
+            if(replyMatcher.empty()) continue;
+            ofxOscMessage info;
+            info.setAddress("/b_info");
+            info.addIntArg(m.getArgAsInt32(i));
+            info.addIntArg(m.getArgAsInt32(i+1));
+            info.addIntArg(m.getArgAsInt32(i+2));
+            info.addFloatArg(m.getArgAsFloat(i+3));
+            replyMatcher.match("/b_info", info.getArgAsInt32(0), info);
+        }
+    });
+    addBuiltinReplyHandler("/c_set", [this](ofxOscMessage &m){
+        int firstIndex = m.getArgAsInt32(0);
+        for(int i = 0; i < m.getNumArgs(); i+=2){
+            handleControlBusSet(firstIndex, m.getArgAsInt32(i), m.getArgAsFloat(i+1));
+        }
+        if(!replyMatcher.empty()) replyMatcher.match("/c_set", firstIndex, m);
+    });
+    addBuiltinReplyHandler("/g_queryTree.reply", [this](ofxOscMessage &m){
+        if(!replyMatcher.empty() && m.getNumArgs() > 1) replyMatcher.match("/g_queryTree.reply", m.getArgAsInt32(1), m);
+        queryTreeReplyEvent.notify(m);
+    });
+    addBuiltinReplyHandler("/fail", [this](ofxOscMessage &m){
+        if(replyMatcher.empty() || m.getNumArgs() < 2) return;
+        replyMatcher.fail(m.getArgAsString(0), m.getArgAsString(1));
+    });
+    
+    // buffer read completed, notify registered, synthdef removed
+    addBuiltinReplyHandler("/done", [this](ofxOscMessage &m){
+        if(m.getNumArgs() > 1 && m.getArgType(1) == OFXOSC_TYPE_INT32) handleDone(m.getArgAsString(0), m.getArgAsInt32(1));
+    });
+    addBuiltinReplyHandler("/d_removed", [](ofxOscMessage &m){});
+    
+    //Node Notifications from server (n_go, n_end.., ugen notifications)
+    for(auto address : {"/n_go", "/n_off", "/n_on", "/n_move", "/n_info", "/tr"}){
+        addBuiltinReplyHandler(address, [this](ofxOscMessage &m){ dispatchNodeFeedback(m); });
+    }
+    addBuiltinReplyHandler("/n_end", [this](ofxOscMessage &m){
+        dispatchNodeFeedback(m);
+        if(m.getNumArgs() > 0) handleNodeEnded(m.getArgAsInt32(0));
+    });
 }
 
 ofxSCServer::~ofxSCServer()
 {
+    stopIOThread();
 }
 
 ofxSCServer *ofxSCServer::local()
@@ -69,119 +148,505 @@ ofxSCServer *ofxSCServer::local()
 // dummy method for oF event notification system
 void ofxSCServer::_process(ofEventArgs &e)
 {
+    if(ioThreadRunning){
+        // held writes belong to the app thread, hand them to the I/O thread once per frame
+        flushCoalesced();
+        return;
+    }
 	this->process();
 }
 
 void ofxSCServer::process()
 {
+    // the I/O thread does this on its own, otherwise whoever processes owns the socket
+    if(ioThreadRunning){
+        if(!onIOThread()) return;
+    }else{
+        ownerThreadID = std::this_thread::get_id();
+    }
+    
+    // everything sent this round leaves in one batch
+    osc.beginBatch();
+    if(!ioThreadRunning) flushCoalesced();
+    flushOutbound();
+    flushRealtime();
+    flushScheduled();
+    checkSyncTimeout();
+    replyMatcher.expire(std::chrono::steady_clock::now());
+    pollStatus();
+    osc.endBatch();
+    
+    // decoded and plain replies in the order the server sent them, barriers and
+    // requests rely on it
+    osc.getNextReplies([this](ofxSCReplyEvent &e){
+        dispatchEvent(e);
+    }, [this](ofxOscMessage &m){
+//        ofLog() << m;
+        dispatchReply(m);
+    });
+}
+
+// Heartbeat, independent of the frame rate. Polls fast until the server answers,
+// then backs off while it keeps answering. A missed reply means the server is gone
+// (or rebooting), so we go back to fast polling to catch the boot quickly.
+void ofxSCServer::pollStatus()
+{
+    if(!statusPollSettings.enabled) return;
+    
+    auto now = std::chrono::steady_clock::now();
+    if(now < nextStatusTime) return;
+    
+    if(statusPending){
+        responding = false;
+        statusInterval = statusPollSettings.bootInterval;
+    }
+    
     ofxOscMessage m;
     m.setAddress("/status");
-    osc.sendMessage(m);
+    transmitNow(m);
     
-//#ifdef _ofxOscSENDERRECEIVER_H
+    statusPending = true;
+    nextStatusTime = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(statusInterval));
+}
 
-	while(osc.hasWaitingMessages())
-	{
-		ofxOscMessage m;
-		osc.getNextMessage(m);
-//		printf("** got OSC! %s\n", m.getAddress().c_str());
-//        ofLog() << m;
-        
-        if (m.getAddress() == "/status.reply"){
-            int numSynths   = m.getArgAsInt(2);
-            int numGroups   = m.getArgAsInt(3);
-            int numSynthDefs = m.getArgAsInt(4);
-            
-            if(!initializing && numGroups == 1 && numSynthDefs == 0 && numSynths == 0){ //Server rebooted
-                serverBootedEvent.notify(this);
-                initializing = true;
-//                ofLog() << "Server Booted";
+void ofxSCServer::startIOThread()
+{
+    if(ioThreadRunning) return;
+    // opened once and kept, a late wake() may still reach it after a stop
+    if(!ioWakeup.open()) return;
+    ioThreadRunning = true;
+    ioThread = std::thread(&ofxSCServer::ioThreadFunction, this);
+}
+
+void ofxSCServer::stopIOThread()
+{
+    if(!ioThreadRunning) return;
+    // still running until joined, so process() on other threads leaves the socket alone
+    ioThreadStopping = true;
+    ioWakeup.wake();
+    ioThread.join();
+    ioThreadID = std::thread::id();
+    // the thread that stopped it takes the socket back
+    ownerThreadID = std::this_thread::get_id();
+    // what is queued goes out before other threads may send directly again
+    flushOutbound();
+    ioThreadRunning = false;
+    ioThreadStopping = false;
+    flushOutbound();
+    flushRealtime();
+}
+
+void ofxSCServer::ioThreadFunction()
+{
+    ioThreadID = std::this_thread::get_id();
+    while(!ioThreadStopping){
+        process();
+        // announce the sleep before looking for work, so a send or reply that
+        // comes in between wakes it
+        ioWakeup.prepare();
+        if(ioThreadStopping || hasPendingIO()){
+            ioWakeup.cancel();
+            continue;
+        }
+        ioWakeup.wait(getNextIOTime());
+    }
+}
+
+bool ofxSCServer::hasPendingIO() const
+{
+    return !outbound.empty() || !realtimeSender.empty() || osc.hasWaitingReplies();
+}
+
+std::chrono::steady_clock::time_point ofxSCServer::getNextIOTime() const
+{
+    auto next = std::min(scheduler.getNextUpdate(), replyMatcher.getNextDeadline());
+    if(statusPollSettings.enabled) next = std::min(next, nextStatusTime);
+    if(syncBarrierPending && syncTimeout > 0){
+        std::lock_guard<std::mutex> lock(syncBarriersMutex);
+        if(!syncBarriers.empty()){
+            auto timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(syncTimeout));
+            next = std::min(next, syncBarriers.front().sentTime + timeout);
+        }
+    }
+    return next;
+}
+
+// Everything that reaches the socket goes through here. Held back while a sync barrier
+// is pending, otherwise on to transmitNow().
+void ofxSCServer::transmit(const ofxOscMessage &m, bool wrapInBundle, uint64_t timetag)
+{
+    if(syncBarrierPending){
+        OutboundItem item;
+        item.message = m;
+        item.wrapInBundle = wrapInBundle;
+        item.timetag = timetag;
+        if(holdBehindBarrier(item)) return;
+    }
+    transmitNow(m, wrapInBundle, timetag);
+}
+
+void ofxSCServer::transmit(const ofxOscBundle &b, uint64_t timetag)
+{
+    if(syncBarrierPending){
+        OutboundItem item;
+        item.bundle = b;
+        item.isBundle = true;
+        item.timetag = timetag;
+        if(holdBehindBarrier(item)) return;
+    }
+    transmitNow(b, timetag);
+}
+
+// Only the owner thread touches the socket, the I/O thread or the one running
+// process(). Other threads hand their messages over, also without the I/O thread.
+void ofxSCServer::transmitNow(const ofxOscMessage &m, bool wrapInBundle, uint64_t timetag)
+{
+    if(!canSendHere()){
+        OutboundItem item;
+        item.message = m;
+        item.wrapInBundle = wrapInBundle;
+        item.timetag = timetag;
+        enqueue(item);
+    }else{
+        osc.sendMessage(m, wrapInBundle, timetag);
+    }
+}
+
+void ofxSCServer::transmitNow(const ofxOscBundle &b, uint64_t timetag)
+{
+    if(!canSendHere()){
+        OutboundItem item;
+        item.bundle = b;
+        item.isBundle = true;
+        item.timetag = timetag;
+        enqueue(item);
+    }else{
+        osc.sendBundle(b, timetag);
+    }
+}
+
+void ofxSCServer::transmitNow(const OutboundItem &item)
+{
+    if(item.isBundle){
+        transmitNow(item.bundle, item.timetag);
+    }else{
+        transmitNow(item.message, item.wrapInBundle, item.timetag);
+    }
+}
+
+void ofxSCServer::enqueue(OutboundItem &item)
+{
+    if(outbound.push(item)){
+        ioWakeup.wake();
+        return;
+    }
+    // Full, the owner is behind: give it a moment rather than dropping control
+    // messages, but don't hang if nobody calls process()
+    if(!outboundStalled){
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(OUTBOUND_WAIT_MS);
+        while(std::chrono::steady_clock::now() < deadline){
+            ioWakeup.wake();
+            std::this_thread::yield();
+            if(outbound.push(item)){
+                ioWakeup.wake();
+                return;
             }
         }
-		
-		/*-----------------------------------------------------------------------------
-		 * /done
-		 *  - buffer read completed
-		 /*---------------------------------------------------------------------------*/
-		else if (m.getAddress() == "/done")
-		{
-//			int index = m.getArgAsInt32(1);
-//			printf("** buffer read completed, ID %d\n", index);
-//			buffers[index]->ready = true;
-		}
-        
-        else if (m.getAddress() == "/synced")
-        {
-            int id = m.getArgAsInt(0);
-            if(id == INTIALIZATION_ID && initializing){
-                initializing = false;
-                serverInitializedEvent.notify(this);
-//                ofLog() << "Server Initialized";
+        if(!outboundStalled.exchange(true)){
+            ofLogError("ofxSCServer") << "send queue full for " << OUTBOUND_WAIT_MS << " ms, dropping sends from other threads until "
+                << (ioThreadRunning ? "the I/O thread" : "process()") << " catches up";
+        }
+    }
+    droppedSends.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ofxSCServer::flushOutbound()
+{
+    osc.beginBatch();
+    OutboundItem item;
+    while(outbound.pop(item)){
+        if(item.isBundle){
+            osc.sendBundle(item.bundle, item.timetag);
+        }else{
+            osc.sendMessage(item.message, item.wrapInBundle, item.timetag);
+        }
+    }
+    osc.endBatch();
+    outboundStalled = false;
+}
+
+void ofxSCServer::setStatusPollSettings(const ofxSCStatusPollSettings &settings)
+{
+    statusPollSettings = settings;
+    statusInterval = responding ? settings.interval : settings.bootInterval;
+    nextStatusTime = std::chrono::steady_clock::now();
+    ioWakeup.wake();
+}
+
+void ofxSCServer::dispatchReply(ofxOscMessage &m)
+{
+    auto it = replyHandlers.find(ofxSCAddressHash(m.getAddress().c_str()));
+    // a foreign address with the same hash isn't handled either
+    if(it == replyHandlers.end() || it->second.handlers.empty() || it->second.address != m.getAddress()){
+        //Poll replies and SendReply messages from synths
+        dispatchNodeFeedback(m);
+        return;
+    }
+    // index based, handlers may register new handlers while being called
+    auto &handlers = it->second.handlers;
+    for(size_t i = 0; i < handlers.size(); i++) handlers[i].handler(m);
+}
+
+void ofxSCServer::dispatchEvent(const ofxSCReplyEvent &e)
+{
+    switch(e.type){
+        case OFXSC_REPLY_NODE_END:
+            dispatchNodeFeedback(e);
+            handleNodeEnded(e.args[0]);
+            break;
+        case OFXSC_REPLY_NODE_GO:
+        case OFXSC_REPLY_NODE_OFF:
+        case OFXSC_REPLY_NODE_ON:
+        case OFXSC_REPLY_NODE_MOVE:
+        case OFXSC_REPLY_TRIGGER:
+            dispatchNodeFeedback(e);
+            break;
+        case OFXSC_REPLY_CONTROL_SET:
+            handleControlBusSet(e.args[1], e.args[0], e.value);
+            if(!replyMatcher.empty()){
+                // one event per pair, the request gathers them
+                ofxOscMessage m;
+                e.toMessage(m);
+                replyMatcher.match("/c_set", e.args[1], m);
+            }
+            break;
+        case OFXSC_REPLY_BUFFER_INFO:
+            handleBufferInfo(e.args[0], e.args[1], e.args[2], e.value);
+            if(!replyMatcher.empty()){
+                ofxOscMessage m;
+                e.toMessage(m);
+                replyMatcher.match("/b_info", e.args[0], m);
+            }
+            break;
+        case OFXSC_REPLY_SYNCED:
+            handleSynced(e.args[0]);
+            break;
+        case OFXSC_REPLY_DONE:
+            if(e.numArgs > 0) handleDone(e.command, e.args[0]);
+            break;
+        default:
+            break;
+    }
+    
+    // user handlers still get a message, built only when there is one
+    auto it = replyHandlers.find(ofxSCAddressHash(e.getAddress()));
+    if(it == replyHandlers.end() || it->second.address != e.getAddress()) return;
+    auto &handlers = it->second.handlers;
+    ofxOscMessage m;
+    for(size_t i = 0; i < handlers.size(); i++){
+        if(handlers[i].builtin) continue;
+        if(m.getAddress().empty()) e.toMessage(m);
+        handlers[i].handler(m);
+    }
+}
+
+// The node is called with the index locked, so another thread destroying it
+// waits in removeNodeListener() until its feedback has been delivered.
+void ofxSCServer::dispatchNodeFeedback(ofxOscMessage &m)
+{
+    if(m.getNumArgs() == 0) return;
+    int nodeID = m.getArgAsInt(0);
+    std::lock_guard<std::recursive_mutex> lock(nodesMutex);
+    ofxSCNode *node = nodeID > 0 ? nodes.get(nodeID) : nullptr;
+    if(node != nullptr) node->feedbackListener(m);
+}
+
+void ofxSCServer::dispatchNodeFeedback(const ofxSCReplyEvent &e)
+{
+    int nodeID = e.args[0];
+    std::lock_guard<std::recursive_mutex> lock(nodesMutex);
+    ofxSCNode *node = nodeID > 0 ? nodes.get(nodeID) : nullptr;
+    if(node != nullptr) node->feedbackEvent(e);
+}
+
+int ofxSCServer::addReplyHandler(const std::string &address, ofxSCReplyHandler handler)
+{
+    ReplyHandlerList &list = replyHandlers[ofxSCAddressHash(address.c_str())];
+    if(list.address.empty()){
+        list.address = address;
+    }else if(list.address != address){
+        ofLogError("ofxSCServer") << "addReplyHandler(): " << address << " collides with " << list.address;
+        return -1;
+    }
+    int id = nextReplyHandlerID++;
+    list.handlers.push_back({id, handler, false});
+    return id;
+}
+
+int ofxSCServer::addBuiltinReplyHandler(const std::string &address, ofxSCReplyHandler handler)
+{
+    int id = addReplyHandler(address, handler);
+    if(id >= 0) replyHandlers[ofxSCAddressHash(address.c_str())].handlers.back().builtin = true;
+    return id;
+}
+
+void ofxSCServer::removeReplyHandler(int handlerID)
+{
+    for(auto &list : replyHandlers){
+        auto &handlers = list.second.handlers;
+        for(auto it = handlers.begin(); it != handlers.end(); ++it){
+            if(it->id == handlerID){
+                handlers.erase(it);
+                return;
             }
         }
+    }
+}
 
-		/*-----------------------------------------------------------------------------
-		 * /b_info
-		 *  - information on buffer size and channels
-		/*---------------------------------------------------------------------------*/
-		else if (m.getAddress() == "/b_info")
-		{
-			int index = m.getArgAsInt32(0);
-			buffers[index]->frames = m.getArgAsInt32(1);
-			buffers[index]->channels = m.getArgAsInt32(2);
-			buffers[index]->sampleRate = m.getArgAsFloat(3);
-			buffers[index]->ready = true;			
-		}
-		
-		// buffer alloc/read failed
-		else if (m.getAddress() == "/fail")
-		{
-		}
-        
-        else if (m.getAddress() == "/d_removed") //What it does? just one string argument.
-        {
+void ofxSCServer::handleStatusReply(ofxOscMessage &m)
+{
+    if(m.getNumArgs() < 9) return;
+    
+    ofxSCServerStatus reply;
+    reply.numUGens = m.getArgAsInt(1);
+    reply.numSynths = m.getArgAsInt(2);
+    reply.numGroups = m.getArgAsInt(3);
+    reply.numSynthDefs = m.getArgAsInt(4);
+    reply.avgCPU = m.getArgAsFloat(5);
+    reply.peakCPU = m.getArgAsFloat(6);
+    reply.nominalSampleRate = m.getArgAsDouble(7);
+    reply.actualSampleRate = m.getArgAsDouble(8);
+    {
+        std::lock_guard<std::mutex> lock(statusMutex);
+        reply.numReplies = status.numReplies + 1;
+        status = reply;
+    }
+    
+    statusPending = false;
+    if(responding){
+        statusInterval = std::min(statusInterval * statusPollSettings.backoff, statusPollSettings.maxInterval);
+    }else{
+        responding = true;
+        statusInterval = statusPollSettings.interval;
+    }
+    
+    if(!initializing && reply.numGroups == 1 && reply.numSynthDefs == 0 && reply.numSynths == 0){ //Server rebooted
+        serverBootedEvent.notify(this);
+        initializing = true;
+//        ofLog() << "Server Booted";
+    }
+}
+
+void ofxSCServer::handleSynced(int id)
+{
+    if(syncBarrierPending) releaseSyncBarriers(id);
+    if(id == INTIALIZATION_ID && initializing){
+        initializing = false;
+        serverInitializedEvent.notify(this);
+//        ofLog() << "Server Initialized";
+    }
+}
+
+// The id goes back to the allocator, unless a node object still holds it:
+// then it does once it lets go (removeNodeListener), so an object that
+// outlives its node never shares its id with a new one.
+void ofxSCServer::handleNodeEnded(int nodeID)
+{
+    {
+        std::lock_guard<std::recursive_mutex> lock(nodesMutex);
+        ofxSCNode *node = nodeID > 0 ? nodes.get(nodeID) : nullptr;
+        if(node != nullptr){
+            node->ended = true;
+            return;
         }
-        
-		else if (m.getAddress() == "/c_set"){
-			int firstIndex = m.getArgAsInt32(0);
-			for(int i = 0; i < m.getNumArgs(); i+=2){
-				int index = m.getArgAsInt32(i);
-				int arrayIndex = index - firstIndex;
-				
-				if(firstIndex >= 0 && firstIndex < 4096 &&
-				   arrayIndex >= 0 &&
-				   controlBusses[firstIndex] != NULL) {
-					
-					try {
-						ofxSCBus* bus = controlBusses[firstIndex];
-						// Add corruption check
-						if(bus->channels > 0 &&
-						   arrayIndex < bus->readValues.size()) {
-							bus->readValues[arrayIndex] = m.getArgAsFloat(i+1);
-						}
-					} catch(...) {
-						// Skip corrupted bus data
-					}
-				}
+    }
+    nodeIDs.free(nodeID);
+}
+
+void ofxSCServer::handleDone(const std::string &command, int arg)
+{
+    // /done /notify clientID, our node ids come from that client's partition
+    if(command == "/notify") nodeIDs.setClientID(arg);
+}
+
+/*-----------------------------------------------------------------------------
+ * /b_info
+ *  - information on buffer size and channels
+/*---------------------------------------------------------------------------*/
+void ofxSCServer::handleBufferInfo(int index, int frames, int channels, float sampleRate)
+{
+	std::lock_guard<std::mutex> lock(resourcesMutex);
+	ofxSCBuffer *buffer = index >= 0 ? buffers.get(index) : NULL;
+	if(buffer == NULL) return;
+	buffer->frames = frames;
+	buffer->channels = channels;
+	buffer->sampleRate = sampleRate;
+	buffer->ready = true;
+}
+
+void ofxSCServer::handleControlBusSet(int firstIndex, int index, float value)
+{
+	int arrayIndex = index - firstIndex;
+	
+	std::lock_guard<std::mutex> lock(resourcesMutex);
+	if(firstIndex >= 0 &&
+	   arrayIndex >= 0 &&
+	   controlBusses.get(firstIndex) != NULL) {
+		
+		try {
+			ofxSCBus* bus = controlBusses.get(firstIndex);
+			// Add corruption check
+			if(bus->channels > 0 &&
+			   arrayIndex < bus->readValues.size()) {
+				bus->readValues[arrayIndex] = value;
 			}
+		} catch(...) {
+			// Skip corrupted bus data
 		}
-        else if (m.getAddress() == "/g_queryTree.reply"){
-            queryTreeReplyEvent.notify(m);
-        }
-        
-        //Node Notifications from server (n_go, n_end.., ugen notifications)
-        //And Poll replies from synths
-        else{
-            for(auto &nff : nodeFeedbackFunctions) nff.second(m);
-        }
 	}
-	
-//#else
-//
-//	fprintf(stderr, "This version of ofxOsc does not have support for sender/receive objects. Please update to enable receiving responses from SuperCollider.\n");
-//
-//#endif
-	
+}
+
+/*-----------------------------------------------------------------------------
+ * Requests
+ *  - registered before sending, the reply may come back on the I/O thread
+ *    before sendMsg() returns
+/*---------------------------------------------------------------------------*/
+std::shared_future<ofxSCReply> ofxSCServer::request(ofxOscMessage &m, const std::string &replyAddress, int key, int numArgs, ofxSCReplyCallback callback)
+{
+    auto deadline = ofxSCReplyMatcher::TimePoint::max();
+    if(requestTimeout > 0){
+        deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(requestTimeout));
+    }
+    std::shared_future<ofxSCReply> future = replyMatcher.expect(m.getAddress(), replyAddress, key, numArgs, callback, deadline);
+    sendMsg(m);
+    return future;
+}
+
+std::shared_future<ofxSCReply> ofxSCServer::queryBuffer(int bufnum, ofxSCReplyCallback callback)
+{
+    ofxOscMessage m;
+    m.setAddress("/b_query");
+    m.addIntArg(bufnum);
+    return request(m, "/b_info", bufnum, 4, callback);
+}
+
+std::shared_future<ofxSCReply> ofxSCServer::getControlBusses(int index, int count, ofxSCReplyCallback callback)
+{
+    ofxOscMessage m;
+    m.setAddress("/c_get");
+    for(int i = 0; i < count; i++){
+        m.addIntArg(index + i);
+    }
+    return request(m, "/c_set", index, count * 2, callback);
+}
+
+std::shared_future<ofxSCReply> ofxSCServer::queryTree(int groupID, bool controls, ofxSCReplyCallback callback)
+{
+    ofxOscMessage m;
+    m.setAddress("/g_queryTree");
+    m.addIntArg(groupID);
+    m.addIntArg(controls ? 1 : 0);
+    return request(m, "/g_queryTree.reply", groupID, 0, callback);
 }
 
 void ofxSCServer::notify()
@@ -189,7 +654,7 @@ void ofxSCServer::notify()
 	ofxOscMessage m;
 	m.setAddress("/notify");
 	m.addIntArg(1);
-	osc.sendMessage(m, true);
+	transmit(m, true);
 }
 
 void ofxSCServer::sendInitializationSyncMessage(){
@@ -201,62 +666,371 @@ void ofxSCServer::sendInitializationSyncMessage(){
 
 void ofxSCServer::sendMsg(ofxOscMessage& m)
 {
-    if(toSendBundle.getMessageCount() > 1000) sendStoredBundle();
     if(waitToSend){
-        toSendBundle.addMessage(m);
+        stage(m);
     }else{
-        osc.sendMessage(m, true, b_latency ? getNowTimetag(latency) : 1);
+        transmit(m, true, b_latency ? getNowTimetag(latency) : 1);
     }
 }
 
 void ofxSCServer::sendBundle(ofxOscBundle& b)
 {
-    if(toSendBundle.getMessageCount() > (1000-b.getMessageCount())) sendStoredBundle();
     if(waitToSend){
         for(int i = 0; i < b.getMessageCount(); i++){
-            toSendBundle.addMessage(b.getMessageAt(i));
+            stage(b.getMessageAt(i));
         }
     }else{
-        osc.sendBundle(b, b_latency ? getNowTimetag(latency) : 1);
+        sendBundle(b, b_latency ? getNowTimetag(latency) : 1);
+    }
+}
+
+void ofxSCServer::sendBundle(const ofxOscBundle& b, uint64_t timetag)
+{
+    size_t size = ofxOscSenderReceiver::getEncodedSize(b);
+    if(needsSplit(size + NESTED_BUNDLE_OVERHEAD)){
+        transmitSplit(b, timetag, size);
+    }else{
+        transmit(b, timetag);
+    }
+}
+
+void ofxSCServer::flushRealtime()
+{
+    if(realtimeSender.empty()) return;
+    realtimeSender.drain([this](const char *data, size_t size){
+        osc.sendEncoded(data, size);
+    });
+}
+
+void ofxSCServer::flushScheduled()
+{
+    auto now = std::chrono::steady_clock::now();
+    if(scheduler.getNextUpdate() > now) return;
+    scheduler.update(now, [this](const ofxOscBundle &b, ofxSCScheduler::TimePoint time){
+        sendBundle(b, timetagClock.getTimetag(time));
+    });
+}
+
+/*-----------------------------------------------------------------------------
+ * Sync barriers
+ *  - a barrier's /sync waits behind the barrier before it like any other
+ *    message, so it also covers what that one held back
+/*---------------------------------------------------------------------------*/
+std::shared_future<bool> ofxSCServer::syncBarrier()
+{
+    ofxOscMessage m;
+    m.setAddress("/sync");
+    bool sendNow;
+    std::shared_future<bool> future;
+    {
+        std::lock_guard<std::mutex> lock(syncBarriersMutex);
+        int id = nextSyncBarrierID;
+        nextSyncBarrierID = id == INT_MAX ? SYNC_BARRIER_BASE_ID : id + 1;
+        m.addIntArg(id);
+        
+        sendNow = syncBarriers.empty();
+        if(!sendNow){
+            OutboundItem item;
+            item.message = m;
+            item.wrapInBundle = true;
+            syncBarriers.back().held.push_back(item);
+        }
+        SyncBarrier barrier;
+        barrier.id = id;
+        barrier.sentTime = std::chrono::steady_clock::now();
+        future = barrier.promise.get_future().share();
+        syncBarriers.push_back(std::move(barrier));
+        syncBarrierPending = true;
+    }
+    // outside the lock, handing it to a busy I/O thread may have to wait
+    if(sendNow) transmitNow(m, true);
+    return future;
+}
+
+size_t ofxSCServer::getNumSyncBarriers() const
+{
+    std::lock_guard<std::mutex> lock(syncBarriersMutex);
+    return syncBarriers.size();
+}
+
+bool ofxSCServer::holdBehindBarrier(OutboundItem &item)
+{
+    std::lock_guard<std::mutex> lock(syncBarriersMutex);
+    if(syncBarriers.empty()) return false;
+    syncBarriers.back().held.push_back(std::move(item));
+    return true;
+}
+
+void ofxSCServer::releaseSyncBarriers(int id)
+{
+    std::lock_guard<std::mutex> lock(syncBarriersMutex);
+    auto it = std::find_if(syncBarriers.begin(), syncBarriers.end(), [id](const SyncBarrier &b){ return b.id == id; });
+    if(it == syncBarriers.end()) return;
+    size_t count = it - syncBarriers.begin() + 1;
+    for(size_t i = 0; i < count; i++){
+        releaseFrontSyncBarrier(true);
     }
 }
 
+void ofxSCServer::checkSyncTimeout()
+{
+    if(!syncBarrierPending || syncTimeout <= 0) return;
+    std::lock_guard<std::mutex> lock(syncBarriersMutex);
+    if(syncBarriers.empty()) return;
+    auto timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(syncTimeout));
+    if(std::chrono::steady_clock::now() - syncBarriers.front().sentTime < timeout) return;
+    ofLogWarning("ofxSCServer") << "no /synced for sync barrier " << syncBarriers.front().id << " after "
+        << syncTimeout << " s, releasing " << syncBarriers.front().held.size() << " held messages";
+    releaseFrontSyncBarrier(false);
+}
+
+void ofxSCServer::releaseFrontSyncBarrier(bool synced)
+{
+    // sent while the lock is held so nothing sent meanwhile overtakes them. This runs
+    // where replies are processed, on the I/O thread if there is one, so it never waits
+    SyncBarrier &barrier = syncBarriers.front();
+    for(auto &item : barrier.held){
+        transmitNow(item);
+    }
+    barrier.promise.set_value(synced);
+    syncBarriers.pop_front();
+    // the next barrier's /sync was among the released messages
+    if(!syncBarriers.empty()) syncBarriers.front().sentTime = std::chrono::steady_clock::now();
+    syncBarrierPending = !syncBarriers.empty();
+}
+
 void ofxSCServer::setWaitToSend(bool b){
     waitToSend = b;
-    toSendBundle.clear();
+    std::lock_guard<std::mutex> lock(stagingBuffersMutex);
+    for(auto &buffer : stagingBuffers){
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        buffer->messages.clear();
+        buffer->size = 0;
+    }
 }
 
 bool ofxSCServer::getWaitToSend(){
     return waitToSend;
 }
 
+ofxSCServer::StagingBuffer &ofxSCServer::getStagingBuffer(){
+    // one lookup per thread and server, then served from the last one used
+    thread_local std::unordered_map<uint64_t, std::shared_ptr<StagingBuffer>> threadBuffers;
+    thread_local uint64_t lastUID = 0;
+    thread_local StagingBuffer *lastBuffer = nullptr;
+    if(lastUID == uid) return *lastBuffer;
+    
+    std::shared_ptr<StagingBuffer> &buffer = threadBuffers[uid];
+    if(!buffer){
+        buffer = std::make_shared<StagingBuffer>();
+        std::lock_guard<std::mutex> lock(stagingBuffersMutex);
+        stagingBuffers.push_back(buffer);
+    }
+    lastUID = uid;
+    lastBuffer = buffer.get();
+    return *buffer;
+}
+
+void ofxSCServer::stage(const ofxOscMessage &m){
+    StagingBuffer &buffer = getStagingBuffer();
+    uint64_t order = nextStagingOrder.fetch_add(1, std::memory_order_relaxed);
+    size_t size = BUNDLE_ELEMENT_SIZE + ofxOscSenderReceiver::getEncodedSize(m);
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.messages.emplace_back(order, m);
+    buffer.size += size;
+}
+
 void ofxSCServer::sendStoredBundle(){
-    osc.sendBundle(toSendBundle);
-    toSendBundle.clear();
+    std::vector<std::pair<uint64_t, ofxOscMessage>> staged;
+    size_t size = 0;
+    {
+        std::lock_guard<std::mutex> lock(stagingBuffersMutex);
+        for(auto it = stagingBuffers.begin(); it != stagingBuffers.end();){
+            StagingBuffer &buffer = **it;
+            {
+                std::lock_guard<std::mutex> bufferLock(buffer.mutex);
+                std::move(buffer.messages.begin(), buffer.messages.end(), std::back_inserter(staged));
+                size += buffer.size;
+                buffer.messages.clear();
+                buffer.size = 0;
+            }
+            // only we hold it, its thread has exited
+            if(it->use_count() == 1){
+                it = stagingBuffers.erase(it);
+            }else{
+                ++it;
+            }
+        }
+    }
+    if(staged.empty()) return;
+    
+    // each buffer is in order already, this interleaves them
+    std::sort(staged.begin(), staged.end(), [](const std::pair<uint64_t, ofxOscMessage> &a, const std::pair<uint64_t, ofxOscMessage> &b){
+        return a.first < b.first;
+    });
+    ofxOscBundle bundle;
+    for(auto &message : staged) bundle.addMessage(message.second);
+    
+    size_t bundleSize = BUNDLE_HEADER_SIZE + size;
+    if(needsSplit(bundleSize + NESTED_BUNDLE_OVERHEAD)){
+        transmitSplit(bundle, 1, bundleSize);
+    }else{
+        transmit(bundle);
+    }
 }
 
-void ofxSCServer::addNodeListener(ofxSCNode* node){
-    nodeFeedbackFunctions[node] = [node](ofxOscMessage &msg){
-        if(node != nullptr && node->nodeID == msg.getArgAsInt(0))
-            node->feedbackListener(msg);
+void ofxSCServer::setCoalescing(bool b){
+    if(!b) flushCoalesced();
+    coalescing = b;
+}
+
+void ofxSCServer::coalesceControl(int nodeID, const std::string &control, float value){
+    std::lock_guard<std::mutex> lock(coalescerMutex);
+    coalescer.setControl(nodeID, control, value);
+}
+
+void ofxSCServer::coalesceControl(int nodeID, const std::string &control, int value){
+    std::lock_guard<std::mutex> lock(coalescerMutex);
+    coalescer.setControl(nodeID, control, value);
+}
+
+void ofxSCServer::coalesceBus(int index, float value){
+    std::lock_guard<std::mutex> lock(coalescerMutex);
+    coalescer.setBus(index, value);
+}
+
+void ofxSCServer::flushCoalesced(){
+    ofxOscBundle b;
+    {
+        std::lock_guard<std::mutex> lock(coalescerMutex);
+        if(coalescer.empty()) return;
+        coalescer.flush(b);
+    }
+    sendBundle(b);
+}
+
+ofxSCServerStatus ofxSCServer::getStatus() const{
+    std::lock_guard<std::mutex> lock(statusMutex);
+    return status;
+}
+
+ofxSCCoalescingStats ofxSCServer::getCoalescingStats() const{
+    std::lock_guard<std::mutex> lock(coalescerMutex);
+    return coalescer.getStats();
+}
+
+void ofxSCServer::setMaxDatagramSize(size_t size){
+    maxDatagramSize = size;
+}
+
+void ofxSCServer::setPathMTU(size_t mtu){
+    if(mtu < MIN_PATH_MTU){
+        ofLogError("ofxSCServer") << "setPathMTU(): " << mtu << " is below the IPv4 minimum of " << MIN_PATH_MTU;
+        return;
+    }
+    setMaxDatagramSize(mtu - IP_UDP_HEADER_SIZE);
+}
+
+// the I/O thread owns the socket while it runs
+template<typename F>
+bool ofxSCServer::withIOThreadStopped(F &&f){
+    bool restartIOThread = ioThreadRunning;
+    stopIOThread();
+    bool result = f();
+    if(restartIOThread) startIOThread();
+    return result;
+}
+
+bool ofxSCServer::setTCP(bool b){
+    return withIOThreadStopped([&]{
+        ofxOscSenderReceiverSettings settings = osc.getSettings();
+        settings.tcp = b;
+        return osc.setup(settings);
+    });
+}
+
+bool ofxSCServer::setTransport(std::unique_ptr<ofxSCTransport> transport){
+    return withIOThreadStopped([&]{
+        return osc.setTransport(std::move(transport));
+    });
+}
+
+// Splits b into consecutive bundles that each fit in a datagram, all sent with the
+// same timetag so the server still executes them together. Nested bundles are kept
+// whole. An element that doesn't fit on its own is sent alone and will likely be
+// dropped by the network.
+void ofxSCServer::transmitSplit(const ofxOscBundle &b, uint64_t timetag, size_t encodedSize){
+    // each chunk is a bundle of its own, sent nested
+    size_t overhead = NESTED_BUNDLE_OVERHEAD + BUNDLE_HEADER_SIZE;
+    size_t budget = maxDatagramSize > overhead ? maxDatagramSize - overhead : 0;
+    // chunks handed to the owner thread are batched when it flushes them
+    bool batch = canSendHere();
+    if(batch) osc.beginBatch();
+    
+    ofxOscBundle chunk;
+    size_t chunkSize = 0;
+    int numChunks = 0;
+    auto add = [&](size_t elementSize){
+        if(chunkSize > 0 && chunkSize + elementSize > budget){
+            transmit(chunk, timetag);
+            chunk.clear();
+            chunkSize = 0;
+            numChunks++;
+        }
+        if(elementSize > budget){
+            ofLogWarning("ofxSCServer") << "bundle element of " << elementSize << " bytes exceeds the max datagram size of " << maxDatagramSize;
+        }
+        chunkSize += elementSize;
     };
+    
+    // same order appendBundle encodes them in, bundles first
+    for(int i = 0; i < b.getBundleCount(); i++){
+        add(BUNDLE_ELEMENT_SIZE + ofxOscSenderReceiver::getEncodedSize(b.getBundleAt(i)));
+        chunk.addBundle(b.getBundleAt(i));
+    }
+    for(int i = 0; i < b.getMessageCount(); i++){
+        add(BUNDLE_ELEMENT_SIZE + ofxOscSenderReceiver::getEncodedSize(b.getMessageAt(i)));
+        chunk.addMessage(b.getMessageAt(i));
+    }
+    if(chunkSize > 0){
+        transmit(chunk, timetag);
+        numChunks++;
+    }
+    if(batch) osc.endBatch();
+    ofLogVerbose("ofxSCServer") << "split " << encodedSize << " byte bundle into " << numChunks << " datagrams";
+}
+
+void ofxSCServer::addNodeListener(ofxSCNode* node){
+    std::lock_guard<std::recursive_mutex> lock(nodesMutex);
+    if(node == nullptr) return;
+    node->ended = false;
+    if(node->nodeID > 0) nodes.set(node->nodeID, node);
 }
 
 void ofxSCServer::removeNodeListener(ofxSCNode *node){
-    nodeFeedbackFunctions.erase(node);
+    bool recycle = false;
+    {
+        std::lock_guard<std::recursive_mutex> lock(nodesMutex);
+        if(node == nullptr || node->nodeID <= 0 || nodes.get(node->nodeID) != node) return;
+        nodes.erase(node->nodeID);
+        recycle = node->ended;
+        node->ended = false;
+    }
+    if(recycle) nodeIDs.free(node->nodeID);
+}
+
+bool ofxSCServer::reclaimEndedNodeID(ofxSCNode *node){
+    std::lock_guard<std::recursive_mutex> lock(nodesMutex);
+    if(node == nullptr || node->nodeID <= 0 || nodes.get(node->nodeID) != node || !node->ended) return false;
+    node->ended = false;
+    return true;
+}
+
+ofxSCNode* ofxSCServer::getNode(int nodeID) const{
+    std::lock_guard<std::recursive_mutex> lock(nodesMutex);
+    return nodeID > 0 ? nodes.get(nodeID) : nullptr;
 }
 
 uint64_t ofxSCServer::getNowTimetag(float latency){
-    auto now = std::chrono::system_clock::now();
-    auto unix_time = now.time_since_epoch();
-    // Add latency (convert seconds to nanoseconds and add)
-    auto latency_duration = std::chrono::duration<double>(latency);
-    std::chrono::duration unix_time_mod = unix_time + std::chrono::duration_cast<std::chrono::nanoseconds>(latency_duration);
-    
-    //https://github.com/juce-framework/JUCE/blob/master/modules/juce_osc/osc/juce_OSCTimeTag.cpp
-    const uint64_t milliseconds = (uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(unix_time_mod).count() + MILISECONDS_FROM_1900_to_1970;
-    uint64_t seconds = milliseconds / 1000;
-    uint32_t fractionalPart = uint32_t (4294967.296 * (milliseconds % 1000));
-    
-    return (seconds << 32) + fractionalPart;
+    return timetagClock.getTimetag(latency);
 }
@@ -12,21 +12,57 @@
  *---------------------------------------------------------------------------*/
 
 
-/// TODO: Poder afegir un missatge de /sync Que faci pausar els missatges osc fins que s'hagi rebut
-/// el /sync corresponent de supercollider, per a no enviar missatges de control abans que s'hagi executat tot el graph per exmeple
-
 #pragma once
 
 #include <vector>
+#include <deque>
+#include <unordered_map>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <atomic>
 
 #include "ofxOsc.h"
 #include "ofxOscSenderReceiver.h"
 #include "ofxSCResourceAllocator.h"
+#include "ofxSCPagedTable.h"
+#include "ofxSCRingBuffer.h"
+#include "ofxSCReplyEvent.h"
+#include "ofxSCWriteCoalescer.h"
+#include "ofxSCTimetagClock.h"
+#include "ofxSCScheduler.h"
+#include "ofxSCReplyMatcher.h"
+#include "ofxSCNodeIDAllocator.h"
+#include "ofxSCRealtimeSender.h"
+#include "ofxSCWakeup.h"
 
 class ofxSCBuffer;
 class ofxSCBus;
 class ofxSCNode;
 
+typedef std::function<void(ofxOscMessage&)> ofxSCReplyHandler;
+
+/// fields of the last /status.reply received from the server
+struct ofxSCServerStatus {
+    int numUGens = 0;
+    int numSynths = 0;
+    int numGroups = 0;
+    int numSynthDefs = 0;
+    float avgCPU = 0;               ///< percent
+    float peakCPU = 0;              ///< percent
+    double nominalSampleRate = 0;
+    double actualSampleRate = 0;
+    uint64_t numReplies = 0;        ///< replies received since the server object was created
+};
+
+/// how often /status is sent to detect boots and keep ofxSCServerStatus up to date
+struct ofxSCStatusPollSettings {
+    bool enabled = true;
+    float interval = 0.25;          ///< seconds between requests once the server answers
+    float bootInterval = 0.05;      ///< seconds between requests while the server doesn't answer
+    float maxInterval = 1.0;        ///< upper limit for the backoff while the server is healthy
+    float backoff = 1.5;            ///< interval multiplier after each answered request
+};
 
 class ofxSCServer
 {
@@ -38,16 +74,131 @@ public:
 	
 	void process();
 	void _process(ofEventArgs &e);
+    
+    /// Move socket work off the frame loop: a dedicated thread flushes outgoing
+    /// messages, polls /status and dispatches replies, so control latency no longer
+    /// depends on the frame time. It sleeps until something is sent or received or
+    /// the next timer (status poll, scheduled bundle, timeouts) is due. While it runs,
+    /// reply handlers, node feedback and the server events are called from that
+    /// thread. Register reply handlers before starting it.
+    void startIOThread();
+    void stopIOThread();
+    bool isIOThreadRunning() const {return ioThreadRunning;};
+    /// \return messages and bundles sent from other threads that found the queue
+    /// to the I/O thread, or to process(), full
+    uint64_t getNumDroppedSends() const {return droppedSends.load(std::memory_order_relaxed);};
 	void notify();
     void sendInitializationSyncMessage();
 	
+	/// Safe from any thread. While the I/O thread runs, other threads queue what they
+	/// send and it wakes to send it, in the order it was queued. Without it they send
+	/// straight away on the native sockets, which are thread safe, and queue for the
+	/// next process() on the others (oscpack's sockets, setTransport()). A full queue
+	/// is waited on for a moment, then what doesn't fit is dropped and counted in
+	/// getNumDroppedSends(), so nothing hangs if process() isn't being called.
 	void sendMsg(ofxOscMessage& message);
     void sendBundle(ofxOscBundle& bundle);
+    /// send now, to be executed at timetag (see getTimetagClock()), split if too big
+    void sendBundle(const ofxOscBundle& bundle, uint64_t timetag);
+    
+    /// bundles scheduled here are sent from process() a lookahead ahead of their
+    /// due time, timetagged for exactly that time
+    ofxSCScheduler &getScheduler(){return scheduler;};
+    
+    /// Where ofxSCSynth, ofxSCGroup and the real-time sender get node ids. Ids come back
+    /// once /n_end arrives (so with notify() on) and no ofxSCNode holds them anymore. The
+    /// client id the server gives in its /notify reply selects the partition.
+    ofxSCNodeIDAllocator &getNodeIDAllocator(){return nodeIDs;};
     
+    /// /s_new, /n_set, /n_free and /c_set from an audio callback, see ofxSCRealtimeSender.
+    /// What it queues is sent from process(). The first call allocates its queue, so
+    /// make it before the audio callback runs
+    ofxSCRealtimeSender &getRealtimeSender(){realtimeSender.reserve(); return realtimeSender;};
+    
+    /// While set, sendMsg and sendBundle store messages instead of sending them and
+    /// sendStoredBundle sends them as one bundle. Any thread may store: each one
+    /// fills a buffer of its own and sendStoredBundle merges them in the order the
+    /// messages were stored, so producers never wait on each other.
     void setWaitToSend(bool b);
     bool getWaitToSend();
     void sendStoredBundle();
     
+    /// Send /sync and hold back everything sent after it until the server has caught up,
+    /// e.g. after /d_recv or /b_allocRead instead of waiting a few frames. Barriers stack,
+    /// each one holds what follows it until its own /synced arrives and the held messages
+    /// then go out in order. /status polling isn't held.
+    /// \return a future that becomes true once the server answered, false if it timed out
+    std::shared_future<bool> syncBarrier();
+    size_t getNumSyncBarriers() const;
+    /// seconds to wait for a /synced before releasing its barrier anyway, 0 to wait forever
+    void setSyncTimeout(float seconds){syncTimeout = seconds;};
+    float getSyncTimeout() const {return syncTimeout;};
+    
+    /// Ask the server and get the answer to this request, matched by reply address and
+    /// key argument, so any number can be outstanding. callback and the future are
+    /// completed from process() (the I/O thread if it runs), after the shared state
+    /// (ofxSCBuffer fields, ofxSCBus::readValues) has been updated. The reply is not ok
+    /// if the server sent /fail or didn't answer within the request timeout.
+    /// /b_query, the reply is /b_info bufnum frames channels sampleRate
+    std::shared_future<ofxSCReply> queryBuffer(int bufnum, ofxSCReplyCallback callback = nullptr);
+    /// /c_get for count busses from index, the reply is /c_set index value ...
+    std::shared_future<ofxSCReply> getControlBusses(int index, int count, ofxSCReplyCallback callback = nullptr);
+    /// /g_queryTree, the reply is /g_queryTree.reply as the server sent it
+    std::shared_future<ofxSCReply> queryTree(int groupID, bool controls = false, ofxSCReplyCallback callback = nullptr);
+    /// seconds to wait for an answer, 2 by default, 0 to wait forever
+    void setRequestTimeout(float seconds){requestTimeout = seconds;};
+    float getRequestTimeout() const {return requestTimeout;};
+    size_t getNumPendingRequests() const {return replyMatcher.size();};
+    
+    /// Largest datagram the server sends. The stored bundle, and any bundle bigger than
+    /// this, goes out as several bundles with the same timetag. Defaults to 65507,
+    /// the largest UDP payload over IPv4.
+    void setMaxDatagramSize(size_t size);
+    size_t getMaxDatagramSize() const {return maxDatagramSize;};
+    /// size datagrams to fit the path MTU (IP and UDP headers deducted) so they are
+    /// never fragmented, e.g. 1500 on ethernet. Values below 68, the IPv4 minimum, are rejected
+    void setPathMTU(size_t mtu);
+    
+    /// Talk to the server over TCP (scsynth started with -t on the same port) instead
+    /// of UDP. Replies come back on the connection, and bundles are never split since
+    /// there is no datagram size to fit. Reconnects, stopping the I/O thread meanwhile.
+    /// Not available on Windows.
+    /// \return false if the connection couldn't be made
+    bool setTCP(bool b);
+    bool getTCP() const {return osc.getSettings().tcp;};
+    
+    /// Exchange packets through transport instead of a socket, e.g. an
+    /// ofxSCLoopbackTransport to an embedded server or a test double. Takes
+    /// ownership, stopping the I/O thread meanwhile like setTCP().
+    /// \return false if transport isn't open
+    bool setTransport(std::unique_ptr<ofxSCTransport> transport);
+    ofxSCTransport *getTransport() const {return osc.getTransport();};
+    
+    void setStatusPollSettings(const ofxSCStatusPollSettings &settings);
+    const ofxSCStatusPollSettings &getStatusPollSettings() const {return statusPollSettings;};
+    
+    /// last parsed /status.reply, doesn't send anything. A copy, the I/O thread
+    /// may be parsing the next one meanwhile
+    ofxSCServerStatus getStatus() const;
+    /// \return true if the last /status request was answered
+    bool isResponding() const {return responding;};
+    
+    /// Opt-in last-value-wins stage: ofxSCSynth::set and ofxSCBus::set on created nodes
+    /// and busses are held and only the latest value per control or bus is sent, as one
+    /// /n_set per node and one /c_set, when the server processes (once per frame).
+    /// Writes may come from any thread.
+    void setCoalescing(bool b);
+    bool getCoalescing() const {return coalescing;};
+    void coalesceControl(int nodeID, const std::string &control, float value);
+    void coalesceControl(int nodeID, const std::string &control, int value);
+    void coalesceBus(int index, float value);
+    /// send the held writes now
+    void flushCoalesced();
+    ofxSCCoalescingStats getCoalescingStats() const;
+    
+    /// where latency timetags come from, resync settings can be changed here
+    ofxSCTimetagClock &getTimetagClock(){return timetagClock;};
+    
     void setLatency(float _latency){latency = _latency;};
     void setBLatency(bool b){b_latency = b;};
     float getLatency(){return latency;};
@@ -58,28 +209,102 @@ public:
 	ofxSCResourceAllocator *allocatorBuffer;
 	ofxSCResourceAllocator *allocatorSynth;
 
-	std::vector<ofxSCBuffer*> buffers;
-    std::vector<ofxSCBus*> controlBusses;
-    std::vector<ofxSCBus*> audioBusses;
+	/// by index, pages are only allocated for the indices in use. Lock
+	/// resourcesMutex around changes, the reply handlers read them
+	ofxSCPagedTable<ofxSCBuffer*> buffers;
+    ofxSCPagedTable<ofxSCBus*> controlBusses;
+    ofxSCPagedTable<ofxSCBus*> audioBusses;
+    std::mutex resourcesMutex;
     
     ofEvent<void> serverBootedEvent;
     ofEvent<void> serverInitializedEvent;
     ofEvent<ofxOscMessage> queryTreeReplyEvent;
     
+    /// index node under its current nodeID so feedback for that id reaches it,
+    /// called again whenever the nodeID of the node changes. Removing a node whose
+    /// /n_end arrived gives its id back to getNodeIDAllocator()
     void addNodeListener(ofxSCNode* node);
     void removeNodeListener(ofxSCNode* node);
+    /// \return true if node's /n_end has arrived, so it can be created again under
+    /// the same id. The id then counts as in use again
+    bool reclaimEndedNodeID(ofxSCNode* node);
+    
+    /// \return the node indexed under nodeID, or nullptr. Only safe to use on the
+    /// thread that destroys the node, feedback is delivered under the index lock
+    ofxSCNode* getNode(int nodeID) const;
+    
+    /// register a handler for messages arriving from the server on the given address,
+    /// e.g. custom SendReply paths. Handlers for the same address are called in
+    /// registration order, after the built-in ones. Messages without any handler are
+    /// routed to the node listeners.
+    /// \return an id to pass to removeReplyHandler, or -1 if the address can't be registered
+    int addReplyHandler(const std::string &address, ofxSCReplyHandler handler);
+    void removeReplyHandler(int handlerID);
     
     ofEvent<ofxOscMessage> newFeedbackMessage;
     
 protected:
 
+    /// the I/O thread sleeps on it, woken by sends, received packets and the
+    /// scheduler. Before osc, whose receive thread wakes it until it is stopped
+    ofxSCWakeup ioWakeup;
 	ofxOscSenderReceiver   osc;
     ofEventListener listener;
-    std::map<ofxSCNode*, std::function<void(ofxOscMessage&)>> nodeFeedbackFunctions;
+    ofxSCPagedTable<ofxSCNode*> nodes;
+    /// held while feedback is delivered to a node, so it can't be destroyed meanwhile.
+    /// Recursive, feedback handlers may create and free nodes
+    mutable std::recursive_mutex nodesMutex;
     
-    bool waitToSend;
+    struct ReplyHandlerEntry{
+        int id;
+        ofxSCReplyHandler handler;
+        bool builtin;
+    };
+    struct ReplyHandlerList{
+        std::string address;
+        std::vector<ReplyHandlerEntry> handlers;
+    };
+    std::unordered_map<uint32_t, ReplyHandlerList> replyHandlers;
+    int nextReplyHandlerID;
     
-    ofxOscBundle toSendBundle;
+    int addBuiltinReplyHandler(const std::string &address, ofxSCReplyHandler handler);
+    
+    void dispatchReply(ofxOscMessage &m);
+    void dispatchEvent(const ofxSCReplyEvent &e);
+    void dispatchNodeFeedback(ofxOscMessage &m);
+    void dispatchNodeFeedback(const ofxSCReplyEvent &e);
+    
+    void handleStatusReply(ofxOscMessage &m);
+    void handleSynced(int id);
+    void handleNodeEnded(int nodeID);
+    void handleDone(const std::string &command, int arg);
+    void handleBufferInfo(int index, int frames, int channels, float sampleRate);
+    void handleControlBusSet(int firstIndex, int index, float value);
+    
+    ofxSCReplyMatcher replyMatcher;
+    float requestTimeout;
+    std::shared_future<ofxSCReply> request(ofxOscMessage &m, const std::string &replyAddress, int key, int numArgs, ofxSCReplyCallback callback);
+    
+    std::atomic<bool> waitToSend;
+    
+    /// what one thread stored while waitToSend is set
+    struct StagingBuffer{
+        std::mutex mutex;           ///< only ever contended by sendStoredBundle()
+        std::vector<std::pair<uint64_t, ofxOscMessage>> messages;     ///< with the order they were stored in
+        size_t size = 0;            ///< encoded, as bundle elements
+    };
+    /// \return the calling thread's buffer, registered on first use
+    StagingBuffer &getStagingBuffer();
+    void stage(const ofxOscMessage &m);
+    
+    std::vector<std::shared_ptr<StagingBuffer>> stagingBuffers;
+    std::mutex stagingBuffersMutex;         ///< for registering a buffer and collecting them
+    std::atomic<uint64_t> nextStagingOrder;
+    /// tells the threads' buffers apart from those of a server that lived at the same address
+    uint64_t uid;
+    static std::atomic<uint64_t> nextUID;
+    
+    size_t maxDatagramSize;
 	
 	static ofxSCServer *plocal;
 	std::string hostname;
@@ -87,9 +312,101 @@ protected:
     
     float latency;
     bool b_latency;
+    ofxSCTimetagClock timetagClock;
+    ofxSCScheduler scheduler;
+    
+    void flushScheduled();
+    
+    ofxSCNodeIDAllocator nodeIDs;
+    ofxSCRealtimeSender realtimeSender;
+    void flushRealtime();
+    
+    ofxSCWriteCoalescer coalescer;
+    mutable std::mutex coalescerMutex;
+    std::atomic<bool> coalescing;
     
     bool initializing;
     
+    ofxSCServerStatus status;
+    mutable std::mutex statusMutex;     ///< guards status, written on the I/O thread when it runs
+    ofxSCStatusPollSettings statusPollSettings;
+    std::chrono::steady_clock::time_point nextStatusTime;
+    float statusInterval;
+    bool statusPending;
+    std::atomic<bool> responding;
+    
+    void pollStatus();
+    
+    /// a message or bundle waiting for the I/O thread
+    struct OutboundItem{
+        ofxOscMessage message;
+        ofxOscBundle bundle;
+        bool isBundle = false;
+        bool wrapInBundle = false;
+        uint64_t timetag = 1;
+    };
+    
+    void transmit(const ofxOscMessage &m, bool wrapInBundle = false, uint64_t timetag = 1);
+    void transmit(const ofxOscBundle &b, uint64_t timetag = 1);
+    /// same, past any sync barrier
+    void transmitNow(const ofxOscMessage &m, bool wrapInBundle = false, uint64_t timetag = 1);
+    void transmitNow(const ofxOscBundle &b, uint64_t timetag = 1);
+    void transmitNow(const OutboundItem &item);
+    void transmitSplit(const ofxOscBundle &b, uint64_t timetag, size_t encodedSize);
+    /// \return true if a packet of size bytes has to be split to be sent
+    bool needsSplit(size_t size) const {return osc.isPacketSizeLimited() && size > maxDatagramSize;};
+    /// hand item to the thread that owns the socket, see sendMsg()
+    void enqueue(OutboundItem &item);
+    void flushOutbound();
+    void ioThreadFunction();
+    /// \return true if the I/O thread has something to do right away
+    bool hasPendingIO() const;
+    /// \return when the I/O thread has to run next without being woken
+    std::chrono::steady_clock::time_point getNextIOTime() const;
+    /// run f with the I/O thread stopped, for swapping the socket
+    template<typename F>
+    bool withIOThreadStopped(F &&f);
+    
+    /// a /sync and what was sent after it, until the next barrier
+    struct SyncBarrier{
+        int id;
+        std::promise<bool> promise;
+        std::vector<OutboundItem> held;
+        std::chrono::steady_clock::time_point sentTime;    ///< of its /sync, once it went out
+    };
+    /// \return false if no barrier is pending and item should go out now
+    bool holdBehindBarrier(OutboundItem &item);
+    /// release every barrier up to id, /synced come back in order
+    void releaseSyncBarriers(int id);
+    void checkSyncTimeout();
+    /// with syncBarriersMutex held
+    void releaseFrontSyncBarrier(bool synced);
+    
+    std::deque<SyncBarrier> syncBarriers;
+    mutable std::mutex syncBarriersMutex;
+    std::atomic<bool> syncBarrierPending;
+    int nextSyncBarrierID;
+    float syncTimeout;
+    
+    ofxSCRingBuffer<OutboundItem> outbound; ///< allocated by the first send from another thread
+    std::atomic<uint64_t> droppedSends;
+    /// a full queue wasn't drained in time, later sends drop without waiting until it is
+    std::atomic<bool> outboundStalled;
+    std::thread ioThread;
+    std::atomic<std::thread::id> ioThreadID;
+    std::atomic<bool> ioThreadRunning;     ///< until the thread has been joined
+    std::atomic<bool> ioThreadStopping;
+    
+    /// the thread that called process() last while there was no I/O thread, the
+    /// one that created the server until then
+    std::atomic<std::thread::id> ownerThreadID;
+    
+    bool onIOThread() const {return std::this_thread::get_id() == ioThreadID.load();};
+    /// \return true on the one thread that may use the socket right now
+    bool onOwnerThread() const {return std::this_thread::get_id() == (ioThreadRunning ? ioThreadID.load() : ownerThreadID.load());};
+    /// \return true if this thread may send without queueing
+    bool canSendHere() const {return onOwnerThread() || (!ioThreadRunning && osc.isThreadSafe());};
+    
 private:
     uint64_t getNowTimetag(float latency = 0);
 };
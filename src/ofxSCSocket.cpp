@@ -0,0 +1,197 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCSocket.h"
+
+#ifdef OFXSC_HAS_NATIVE_SOCKETS
+
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "ofLog.h"
+
+//--------------------------------------------------------------
+ofxSCSocket::ofxSCSocket() : fd(-1), batchDepth(0), receiving(false), wakeReadFd(-1), wakeWriteFd(-1), receiveCalls(0), receivedPackets(0), receivedBytes(0)
+{
+}
+
+//--------------------------------------------------------------
+ofxSCSocket::~ofxSCSocket()
+{
+    // subclasses close() in their destructor, while flush() can still reach them
+    stopReceiving();
+    if(fd >= 0) ::close(fd);
+}
+
+//--------------------------------------------------------------
+void ofxSCSocket::close()
+{
+    stopReceiving();
+    std::lock_guard<std::recursive_mutex> lock(sendMutex);
+    if(fd >= 0){
+        flush();
+        ::close(fd);
+        fd = -1;
+    }
+    batchDepth = 0;
+}
+
+//--------------------------------------------------------------
+void ofxSCSocket::beginBatch()
+{
+    std::lock_guard<std::recursive_mutex> lock(sendMutex);
+    batchDepth++;
+}
+
+//--------------------------------------------------------------
+void ofxSCSocket::endBatch()
+{
+    std::lock_guard<std::recursive_mutex> lock(sendMutex);
+    if(batchDepth > 0 && --batchDepth == 0){
+        flush();
+    }
+}
+
+//--------------------------------------------------------------
+ofxSCTransmitStats ofxSCSocket::getStats() const
+{
+    std::lock_guard<std::recursive_mutex> lock(sendMutex);
+    return stats;
+}
+
+//--------------------------------------------------------------
+bool ofxSCSocket::startReceiving(PacketCallback _callback)
+{
+    if(fd < 0) return false;
+    if(receiveThread.joinable()) return true;
+
+#if defined(__linux__)
+    wakeReadFd = wakeWriteFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(wakeReadFd < 0){
+        ofLogError("ofxSCSocket") << "couldn't create eventfd: " << std::strerror(errno);
+        return false;
+    }
+#else
+    int pipeFds[2];
+    if(pipe(pipeFds) < 0){
+        ofLogError("ofxSCSocket") << "couldn't create wakeup pipe: " << std::strerror(errno);
+        return false;
+    }
+    wakeReadFd = pipeFds[0];
+    wakeWriteFd = pipeFds[1];
+#endif
+
+    callback = _callback;
+    receiving = true;
+    receiveThread = std::thread(&ofxSCSocket::receiveThreadFunction, this);
+    return true;
+}
+
+//--------------------------------------------------------------
+void ofxSCSocket::stopReceiving()
+{
+    if(!receiveThread.joinable()) return;
+    receiving = false;
+    uint64_t wake = 1;
+    if(::write(wakeWriteFd, &wake, sizeof(wake)) < 0){
+        ofLogWarning("ofxSCSocket") << "couldn't wake the receive thread: " << std::strerror(errno);
+    }
+    receiveThread.join();
+    closeWakeup();
+}
+
+//--------------------------------------------------------------
+void ofxSCSocket::closeWakeup()
+{
+    if(wakeReadFd >= 0) ::close(wakeReadFd);
+    if(wakeWriteFd >= 0 && wakeWriteFd != wakeReadFd) ::close(wakeWriteFd);
+    wakeReadFd = wakeWriteFd = -1;
+}
+
+//--------------------------------------------------------------
+void ofxSCSocket::countReceived(uint64_t packets, uint64_t bytes)
+{
+    receiveCalls.fetch_add(1, std::memory_order_relaxed);
+    receivedPackets.fetch_add(packets, std::memory_order_relaxed);
+    receivedBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------------
+ofxSCReceiveStats ofxSCSocket::getReceiveStats() const
+{
+    ofxSCReceiveStats s;
+    s.receiveCalls = receiveCalls.load(std::memory_order_relaxed);
+    s.datagrams = receivedPackets.load(std::memory_order_relaxed);
+    s.bytes = receivedBytes.load(std::memory_order_relaxed);
+    return s;
+}
+
+//--------------------------------------------------------------
+void ofxSCSocket::receiveThreadFunction()
+{
+#if defined(__linux__)
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(epollFd < 0){
+        ofLogError("ofxSCSocket") << "couldn't create epoll instance: " << std::strerror(errno);
+        receiving = false;
+        return;
+    }
+    epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    ev.data.fd = wakeReadFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeReadFd, &ev);
+
+    epoll_event ready[2];
+    while(receiving){
+        int n = epoll_wait(epollFd, ready, 2, -1);
+        if(n < 0){
+            if(errno == EINTR) continue;
+            ofLogError("ofxSCSocket") << "epoll_wait failed: " << std::strerror(errno);
+            break;
+        }
+        bool open = true;
+        for(int i = 0; i < n; i++){
+            if(ready[i].data.fd == fd) open = drainSocket();
+        }
+        if(!open) break;
+    }
+    ::close(epollFd);
+#else
+    pollfd pfds[2];
+    pfds[0].fd = fd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = wakeReadFd;
+    pfds[1].events = POLLIN;
+
+    while(receiving){
+        if(poll(pfds, 2, -1) < 0){
+            if(errno == EINTR) continue;
+            ofLogError("ofxSCSocket") << "poll failed: " << std::strerror(errno);
+            break;
+        }
+        if((pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) && !drainSocket()) break;
+    }
+#endif
+    receiving = false;
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "ofxSCTransport.h"
+
+#if !defined(_WIN32)
+#define OFXSC_HAS_NATIVE_SOCKETS 1
+#endif
+
+#ifdef OFXSC_HAS_NATIVE_SOCKETS
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+/// What the plain POSIX sockets (ofxSCUdpSocket, ofxSCTcpSocket) share: the
+/// descriptor, send batching and the receive thread. The thread sleeps in epoll
+/// (poll elsewhere) until the socket is readable and lets the subclass drain it.
+/// It is woken through an eventfd (a pipe elsewhere) to stop, and joined.
+///
+/// Sending is thread safe: the batch and the send buffers are guarded by
+/// sendMutex, and a packet sent from another thread while a batch is open
+/// goes out with that batch.
+class ofxSCSocket : public ofxSCTransport
+{
+public:
+    virtual ~ofxSCSocket();
+
+    /// stop receiving, send what is queued and close
+    void close() override;
+    bool isOpen() const override {return fd >= 0;};
+
+    void beginBatch() override;
+    void endBatch() override;
+    bool isThreadSafe() const override {return true;};
+
+    /// call callback from a receive thread for every packet that arrives
+    /// \return false if the thread couldn't be set up
+    bool startReceiving(PacketCallback callback) override;
+    /// wake the receive thread and wait for it to finish
+    void stopReceiving() override;
+    /// \return false once stopped, or if the connection went away
+    bool isReceiving() const override {return receiving;};
+
+    ofxSCTransmitStats getStats() const override;
+    ofxSCReceiveStats getReceiveStats() const override;
+
+protected:
+    ofxSCSocket();
+
+    /// read everything waiting on the socket without blocking, called from the receive thread
+    /// \return false if the connection is gone and there is nothing more to wait for
+    virtual bool drainSocket() = 0;
+    void countReceived(uint64_t packets, uint64_t bytes);
+
+    int fd;
+    /// held by send(), flush() and the batch calls of the subclasses. Recursive,
+    /// sending may flush and ending a batch does
+    mutable std::recursive_mutex sendMutex;
+    int batchDepth;             ///< under sendMutex
+    PacketCallback callback;
+    ofxSCTransmitStats stats;   ///< under sendMutex
+    std::atomic<bool> receiving;
+
+private:
+    void receiveThreadFunction();
+    void closeWakeup();
+
+    // written to stop the receive thread, both ends are the same eventfd on Linux
+    int wakeReadFd;
+    int wakeWriteFd;
+    std::thread receiveThread;
+
+    std::atomic<uint64_t> receiveCalls;
+    std::atomic<uint64_t> receivedPackets;
+    std::atomic<uint64_t> receivedBytes;
+};
+
+#endif
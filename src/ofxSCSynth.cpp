@@ -28,8 +28,7 @@ void ofxSCSynth::create(int position, int groupID)
 {
 	ofxOscMessage m;
 
-	if (nodeID == 0)
-		nodeID = ofxSCNode::id_base++;
+	claimNodeID();
 	
 	m.setAddress("/s_new");
 	m.addStringArg(name.c_str());
@@ -104,9 +103,7 @@ void ofxSCSynth::create(int position, int groupID)
 void ofxSCSynth::createAndRun(int position, int groupID, bool run){
     ofxOscMessage m;
 
-    //TODO: Reuse nodeIDs
-    if (nodeID == 0)
-        nodeID = ofxSCNode::id_base++;
+    claimNodeID();
     
     m.setAddress("/s_new");
     m.addStringArg(name.c_str());
@@ -189,13 +186,17 @@ void ofxSCSynth::createAndRun(int position, int groupID, bool run){
 
 void ofxSCSynth::grain(int position, int groupID)
 {
-	nodeID = -1;
+	setNodeID(-1);
 	create(position, groupID);
 }
 
 void ofxSCSynth::set(std::string arg, double value)
 {
-	if (created)
+	if (created && getServer()->getCoalescing())
+	{
+        getServer()->coalesceControl(nodeID, arg, (float)value);
+	}
+	else if (created)
 	{
 		ofxOscMessage m;
 		m.setAddress("/n_set");
@@ -214,7 +215,11 @@ void ofxSCSynth::set(std::string arg, double value)
 void ofxSCSynth::set(std::string arg, int value)
 {
 	
-	if (created)
+	if (created && getServer()->getCoalescing())
+	{
+        getServer()->coalesceControl(nodeID, arg, value);
+	}
+	else if (created)
 	{
 		ofxOscMessage m;
 		m.setAddress("/n_set");
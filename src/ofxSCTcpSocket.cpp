@@ -0,0 +1,223 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCTcpSocket.h"
+
+#ifdef OFXSC_HAS_NATIVE_SOCKETS
+
+#include <cstring>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+
+#include "ofLog.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0      // SO_NOSIGPIPE is set instead
+#endif
+
+// size prefix of every packet
+static const size_t FRAME_HEADER_SIZE = 4;
+// queued bytes that make a batch go out early
+static const size_t MAX_QUEUED = 1 << 20;
+// read size, and the least room kept free in the receive buffer
+static const size_t READ_SIZE = 65536;
+// anything bigger than this is a broken stream rather than a packet
+static const size_t MAX_PACKET_SIZE = 1 << 28;
+
+//--------------------------------------------------------------
+ofxSCTcpSocket::ofxSCTcpSocket() : sendSize(0), sendPackets(0), receiveSize(0)
+{
+}
+
+//--------------------------------------------------------------
+ofxSCTcpSocket::~ofxSCTcpSocket()
+{
+    close();
+}
+
+//--------------------------------------------------------------
+bool ofxSCTcpSocket::open(const std::string &host, int port)
+{
+    close();
+    {
+        std::lock_guard<std::recursive_mutex> lock(sendMutex);
+        sendSize = 0;
+        sendPackets = 0;
+    }
+    receiveSize = 0;
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *destination = nullptr;
+    if(getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &destination) != 0 || destination == nullptr){
+        ofLogError("ofxSCTcpSocket") << "bad host? " << host;
+        return false;
+    }
+
+    fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0){
+        ofLogError("ofxSCTcpSocket") << "couldn't create socket: " << std::strerror(errno);
+        freeaddrinfo(destination);
+        return false;
+    }
+
+    // packets are written whole, don't hold small ones back waiting for more
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+    if(::connect(fd, destination->ai_addr, destination->ai_addrlen) < 0){
+        ofLogError("ofxSCTcpSocket") << "couldn't connect to " << host << " on port " << port << ": " << std::strerror(errno);
+        freeaddrinfo(destination);
+        close();
+        return false;
+    }
+    const sockaddr_in *address = (const sockaddr_in*)destination->ai_addr;
+    remoteEndpoint = osc::IpEndpointName(ntohl(address->sin_addr.s_addr), port);
+    freeaddrinfo(destination);
+
+    return true;
+}
+
+//--------------------------------------------------------------
+void ofxSCTcpSocket::send(const char *data, size_t size)
+{
+    std::memcpy(reserve(size), data, size);
+    commit(size);
+}
+
+//--------------------------------------------------------------
+char *ofxSCTcpSocket::reserve(size_t size)
+{
+    // released by commit() or cancel(), recursive so they can flush()
+    sendMutex.lock();
+    size_t needed = sendSize + FRAME_HEADER_SIZE + size;
+    if(sendBuffer.size() < needed){
+        sendBuffer.resize(needed);
+    }
+    return sendBuffer.data() + sendSize + FRAME_HEADER_SIZE;
+}
+
+//--------------------------------------------------------------
+void ofxSCTcpSocket::commit(size_t size)
+{
+    std::lock_guard<std::recursive_mutex> lock(sendMutex, std::adopt_lock);
+    uint32_t length = (uint32_t)size;
+    char *header = sendBuffer.data() + sendSize;
+    header[0] = (char)(length >> 24);
+    header[1] = (char)(length >> 16);
+    header[2] = (char)(length >> 8);
+    header[3] = (char)length;
+    sendSize += FRAME_HEADER_SIZE + size;
+    sendPackets++;
+
+    if(batchDepth == 0 || sendSize >= MAX_QUEUED){
+        flush();
+    }
+}
+
+//--------------------------------------------------------------
+void ofxSCTcpSocket::cancel()
+{
+    sendMutex.unlock();
+}
+
+//--------------------------------------------------------------
+void ofxSCTcpSocket::flush()
+{
+    std::lock_guard<std::recursive_mutex> lock(sendMutex);
+    if(sendSize == 0) return;
+    if(fd < 0){
+        sendSize = 0;
+        sendPackets = 0;
+        return;
+    }
+
+    size_t sent = 0;
+    while(sent < sendSize){
+        ssize_t n = ::send(fd, sendBuffer.data() + sent, sendSize - sent, MSG_NOSIGNAL);
+        stats.sendCalls++;
+        if(n < 0){
+            if(errno == EINTR) continue;
+            ofLogError("ofxSCTcpSocket") << "send failed, dropping " << sendSize - sent << " bytes: " << std::strerror(errno);
+            break;
+        }
+        sent += n;
+    }
+    stats.datagrams += sendPackets;
+    stats.bytes += sent;
+
+    sendSize = 0;
+    sendPackets = 0;
+}
+
+//--------------------------------------------------------------
+bool ofxSCTcpSocket::drainSocket()
+{
+    while(receiving){
+        if(receiveBuffer.size() < receiveSize + READ_SIZE){
+            receiveBuffer.resize(receiveSize + READ_SIZE);
+        }
+        ssize_t n = ::recv(fd, receiveBuffer.data() + receiveSize, receiveBuffer.size() - receiveSize, MSG_DONTWAIT);
+        if(n == 0){
+            ofLogWarning("ofxSCTcpSocket") << "server closed the connection";
+            return false;
+        }
+        if(n < 0){
+            if(errno == EINTR) continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            ofLogError("ofxSCTcpSocket") << "receive failed: " << std::strerror(errno);
+            return false;
+        }
+        receiveSize += n;
+
+        // hand out every complete packet, keep the partial one for the next read
+        size_t offset = 0;
+        size_t packets = 0;
+        while(receiveSize - offset >= FRAME_HEADER_SIZE){
+            const unsigned char *header = (const unsigned char*)receiveBuffer.data() + offset;
+            size_t length = ((size_t)header[0] << 24) | ((size_t)header[1] << 16) | ((size_t)header[2] << 8) | header[3];
+            if(length > MAX_PACKET_SIZE){
+                ofLogError("ofxSCTcpSocket") << "bad packet size " << length << ", dropping the connection";
+                return false;
+            }
+            if(receiveSize - offset < FRAME_HEADER_SIZE + length){
+                // make sure the rest of it fits
+                if(receiveBuffer.size() < FRAME_HEADER_SIZE + length + READ_SIZE){
+                    receiveBuffer.resize(FRAME_HEADER_SIZE + length + READ_SIZE);
+                }
+                break;
+            }
+            callback(receiveBuffer.data() + offset + FRAME_HEADER_SIZE, length, remoteEndpoint);
+            offset += FRAME_HEADER_SIZE + length;
+            packets++;
+        }
+        if(offset > 0){
+            std::memmove(receiveBuffer.data(), receiveBuffer.data() + offset, receiveSize - offset);
+            receiveSize -= offset;
+        }
+        countReceived(packets, n);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,65 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "ofxSCSocket.h"
+
+#ifdef OFXSC_HAS_NATIVE_SOCKETS
+
+#include <vector>
+
+/// TCP connection to scsynth (started with -t). Every OSC packet is prefixed
+/// by its size as a big endian int32, so there is no datagram size limit.
+/// Packets are encoded straight into the send buffer behind their size prefix:
+/// reserve() takes sendMutex and commit() or cancel() lets go of it, so any
+/// thread may send and packets never interleave. They go out when the batch
+/// ends, or right away outside of one.
+class ofxSCTcpSocket : public ofxSCSocket
+{
+public:
+    ofxSCTcpSocket();
+    ~ofxSCTcpSocket();
+
+    /// connect to host:port, blocks until connected or refused
+    /// \return true on success, errors are logged
+    bool open(const std::string &host, int port);
+
+    /// frame and queue a packet, written out right away outside of a batch
+    void send(const char *data, size_t size) override;
+    /// room behind the size prefix in the send buffer, holds sendMutex until
+    /// commit() or cancel()
+    char *reserve(size_t size) override;
+    void commit(size_t size) override;
+    void cancel() override;
+    void flush() override;
+
+    bool isPacketSizeLimited() const override {return false;};
+
+protected:
+    bool drainSocket() override;
+
+private:
+    // framed packets waiting to be written, under sendMutex
+    std::vector<char> sendBuffer;
+    size_t sendSize;
+    size_t sendPackets;
+
+    // bytes read but not yet split into packets
+    std::vector<char> receiveBuffer;
+    size_t receiveSize;
+
+    osc::IpEndpointName remoteEndpoint;
+};
+
+#endif
@@ -0,0 +1,308 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCTempoClock.h"
+
+#include <cmath>
+#include <mutex>
+#include <vector>
+#include <unordered_set>
+#include <climits>
+#include <algorithm>
+
+#include "ofLog.h"
+
+//--------------------------------------------------------------
+// Everything the clock shares with the events it hands to the scheduler, so they
+// can still run safely, and do nothing, after the clock is gone.
+struct ofxSCTempoClock::State : public std::enable_shared_from_this<State>
+{
+    struct Event{
+        double beat;
+        uint64_t order;
+        int id;
+        BeatFunction function;
+        bool operator>(const Event &other) const {
+            return beat > other.beat || (beat == other.beat && order > other.order);
+        }
+    };
+    
+    ofxSCScheduler *scheduler;
+    mutable std::mutex mutex;
+    
+    double tempo;
+    double baseBeats;           ///< beats at baseTime
+    TimePoint baseTime;
+    double beatsPerBar = 4;
+    double barBeats = 0;        ///< a bar line, bars are counted from here
+    double baseBar = 0;         ///< bar number at barBeats
+    
+    std::vector<Event> events;  ///< min-heap on beat, not handed to the scheduler yet
+    std::unordered_set<int> live;
+    int nextID = 0;
+    uint64_t nextOrder = 0;
+    int pumpID = -1;            ///< scheduler event that hands the next events over
+    TimePoint pumpTime;
+    
+    double beatsAt(TimePoint time) const {
+        return baseBeats + std::chrono::duration<double>(time - baseTime).count() * tempo;
+    }
+    TimePoint timeAt(double beat) const {
+        return baseTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((beat - baseBeats) / tempo));
+    }
+    double nextBarAt(double beat) const {
+        return barBeats + std::ceil((beat - barBeats) / beatsPerBar - 1e-9) * beatsPerBar;
+    }
+    
+    // everything below is called with mutex held
+    
+    int add(double beat, BeatFunction function){
+        int id = nextID;
+        nextID = nextID == INT_MAX ? 0 : nextID + 1;
+        live.insert(id);
+        push(beat, id, function);
+        return id;
+    }
+    
+    void push(double beat, int id, BeatFunction function){
+        events.push_back({beat, nextOrder++, id, function});
+        std::push_heap(events.begin(), events.end(), std::greater<Event>());
+        reschedulePump();
+    }
+    
+    // the pump is a scheduler event at the time of the earliest beat, when the
+    // scheduler reaches it the beat has entered the lookahead window
+    void reschedulePump(){
+        while(!events.empty() && !live.count(events.front().id)){
+            std::pop_heap(events.begin(), events.end(), std::greater<Event>());
+            events.pop_back();
+        }
+        if(events.empty()){
+            cancelPump();
+            return;
+        }
+        TimePoint time = timeAt(events.front().beat);
+        if(pumpID >= 0 && pumpTime == time) return;
+        cancelPump();
+        std::shared_ptr<State> self = shared_from_this();
+        pumpID = scheduler->schedule(time, [self](ofxOscBundle &, TimePoint time){
+            self->pump(time);
+        });
+        pumpTime = time;
+    }
+    
+    void cancelPump(){
+        if(pumpID >= 0) scheduler->cancel(pumpID);
+        pumpID = -1;
+    }
+    
+    // hand every event up to horizon to the scheduler, with the time it has now
+    void pump(TimePoint horizon){
+        std::lock_guard<std::mutex> lock(mutex);
+        pumpID = -1;
+        std::shared_ptr<State> self = shared_from_this();
+        while(!events.empty() && timeAt(events.front().beat) <= horizon){
+            std::pop_heap(events.begin(), events.end(), std::greater<Event>());
+            Event event = std::move(events.back());
+            events.pop_back();
+            if(!live.count(event.id)) continue;
+            scheduler->schedule(timeAt(event.beat), [self, event](ofxOscBundle &bundle, TimePoint){
+                self->run(event, bundle);
+            });
+        }
+        reschedulePump();
+    }
+    
+    // called by the scheduler without any lock, the function may use the clock
+    void run(const Event &event, ofxOscBundle &bundle){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!live.count(event.id)) return;
+        }
+        double next = event.function(bundle, event.beat);
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!live.count(event.id)) return;
+        if(next > 0) push(event.beat + next, event.id, event.function);
+        else live.erase(event.id);
+    }
+};
+
+//--------------------------------------------------------------
+ofxSCTempoClock::ofxSCTempoClock(ofxSCServer *server, double tempo, double beats) : state(std::make_shared<State>())
+{
+    state->scheduler = &server->getScheduler();
+    state->tempo = tempo > 0 ? tempo : 1;
+    state->baseBeats = beats;
+    state->baseTime = std::chrono::steady_clock::now();
+}
+
+//--------------------------------------------------------------
+ofxSCTempoClock::~ofxSCTempoClock()
+{
+    clear();
+}
+
+//--------------------------------------------------------------
+void ofxSCTempoClock::setTempo(double tempo)
+{
+    if(tempo <= 0){
+        ofLogError("ofxSCTempoClock") << "setTempo(): tempo must be positive, not " << tempo;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(state->mutex);
+    auto now = std::chrono::steady_clock::now();
+    state->baseBeats = state->beatsAt(now);
+    state->baseTime = now;
+    state->tempo = tempo;
+    state->reschedulePump();
+}
+
+//--------------------------------------------------------------
+double ofxSCTempoClock::getTempo() const
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->tempo;
+}
+
+//--------------------------------------------------------------
+double ofxSCTempoClock::getBeats() const
+{
+    return getBeats(std::chrono::steady_clock::now());
+}
+
+double ofxSCTempoClock::getBeats(TimePoint time) const
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->beatsAt(time);
+}
+
+//--------------------------------------------------------------
+ofxSCTempoClock::TimePoint ofxSCTempoClock::getTime(double beat) const
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->timeAt(beat);
+}
+
+//--------------------------------------------------------------
+void ofxSCTempoClock::setBeatsPerBar(double beatsPerBar)
+{
+    if(beatsPerBar <= 0){
+        ofLogError("ofxSCTempoClock") << "setBeatsPerBar(): needs at least some beats, not " << beatsPerBar;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(state->mutex);
+    double nextBar = state->nextBarAt(state->beatsAt(std::chrono::steady_clock::now()));
+    state->baseBar += std::round((nextBar - state->barBeats) / state->beatsPerBar);
+    state->barBeats = nextBar;
+    state->beatsPerBar = beatsPerBar;
+}
+
+//--------------------------------------------------------------
+double ofxSCTempoClock::getBeatsPerBar() const
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->beatsPerBar;
+}
+
+//--------------------------------------------------------------
+double ofxSCTempoClock::getBar() const
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    double beats = state->beatsAt(std::chrono::steady_clock::now());
+    return std::floor(state->baseBar + (beats - state->barBeats) / state->beatsPerBar);
+}
+
+//--------------------------------------------------------------
+double ofxSCTempoClock::getNextBar(double beat) const
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->nextBarAt(beat);
+}
+
+//--------------------------------------------------------------
+double ofxSCTempoClock::getNextTimeOnGrid(double quant, double phase) const
+{
+    double beats = getBeats();
+    if(quant <= 0) return beats + phase;
+    return std::ceil((beats - phase) / quant) * quant + phase;
+}
+
+//--------------------------------------------------------------
+int ofxSCTempoClock::scheduleAt(double beat, const ofxOscBundle &bundle)
+{
+    return scheduleAt(beat, [bundle](ofxOscBundle &b, double){
+        b = bundle;
+        return 0.0;
+    });
+}
+
+int ofxSCTempoClock::scheduleAt(double beat, const ofxOscMessage &message)
+{
+    return scheduleAt(beat, [message](ofxOscBundle &b, double){
+        b.addMessage(message);
+        return 0.0;
+    });
+}
+
+int ofxSCTempoClock::scheduleAt(double beat, BeatFunction function)
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->add(beat, function);
+}
+
+//--------------------------------------------------------------
+int ofxSCTempoClock::scheduleIn(double beats, const ofxOscBundle &bundle)
+{
+    return scheduleAt(getBeats() + beats, bundle);
+}
+
+int ofxSCTempoClock::scheduleIn(double beats, const ofxOscMessage &message)
+{
+    return scheduleAt(getBeats() + beats, message);
+}
+
+int ofxSCTempoClock::scheduleIn(double beats, BeatFunction function)
+{
+    return scheduleAt(getBeats() + beats, function);
+}
+
+//--------------------------------------------------------------
+int ofxSCTempoClock::play(BeatFunction function, double quant, double phase)
+{
+    return scheduleAt(getNextTimeOnGrid(quant, phase), function);
+}
+
+//--------------------------------------------------------------
+bool ofxSCTempoClock::cancel(int eventID)
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if(state->live.erase(eventID) == 0) return false;
+    state->reschedulePump();
+    return true;
+}
+
+//--------------------------------------------------------------
+void ofxSCTempoClock::clear()
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->live.clear();
+    state->events.clear();
+    state->cancelPump();
+}
+
+//--------------------------------------------------------------
+size_t ofxSCTempoClock::size() const
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->live.size();
+}
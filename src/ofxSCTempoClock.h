@@ -0,0 +1,89 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <memory>
+#include <functional>
+
+#include "ofxSCServer.h"
+
+/// Musical time for a server, like SuperCollider's TempoClock: a tempo in
+/// beats per second, a beat count, bars, and events scheduled on beats.
+///
+/// Events wait here in beats and are handed to the server's ofxSCScheduler
+/// only when they enter its lookahead window, converted to a time with the
+/// tempo of that moment. Changing the tempo therefore moves every event that
+/// hasn't been handed over yet, only the ones inside the lookahead window
+/// keep their time. Thread safe.
+///
+///     ofxSCTempoClock clock(&server, 120 / 60.0);
+///     clock.play([&](ofxOscBundle &bundle, double beat){
+///         bundle.addMessage(kick);
+///         return 1.0;     // again in one beat, 0 to stop
+///     }, 4);              // starting on the next bar
+class ofxSCTempoClock
+{
+public:
+    typedef ofxSCScheduler::TimePoint TimePoint;
+    /// fills the bundle for beat, which is sent timetagged for that beat.
+    /// \return beats until it runs again, 0 or less to stop
+    typedef std::function<double(ofxOscBundle &bundle, double beat)> BeatFunction;
+
+    ofxSCTempoClock(ofxSCServer *server = ofxSCServer::local(), double tempo = 1, double beats = 0);
+    ~ofxSCTempoClock();
+
+    /// beats per second, from now on
+    void setTempo(double tempo);
+    double getTempo() const;
+    void setBPM(double bpm) {setTempo(bpm / 60);};
+    double getBPM() const {return getTempo() * 60;};
+
+    double getBeats() const;
+    double getBeats(TimePoint time) const;
+    /// \return when beat happens at the current tempo
+    TimePoint getTime(double beat) const;
+
+    /// beats per bar from the next bar line on, 4 by default
+    void setBeatsPerBar(double beatsPerBar);
+    double getBeatsPerBar() const;
+    double getBar() const;
+    /// \return the beat the next bar starts on, beat itself if it's on a bar line
+    double getNextBar(double beat) const;
+    double getNextBar() const {return getNextBar(getBeats());};
+    /// \return the next beat that is a multiple of quant plus phase
+    double getNextTimeOnGrid(double quant = 1, double phase = 0) const;
+
+    /// \return an id for cancel()
+    int scheduleAt(double beat, const ofxOscBundle &bundle);
+    int scheduleAt(double beat, const ofxOscMessage &message);
+    int scheduleAt(double beat, BeatFunction function);
+    /// same, beats from now
+    int scheduleIn(double beats, const ofxOscBundle &bundle);
+    int scheduleIn(double beats, const ofxOscMessage &message);
+    int scheduleIn(double beats, BeatFunction function);
+    /// start function on the next multiple of quant beats
+    int play(BeatFunction function, double quant = 1, double phase = 0);
+
+    /// stop an event or a repeating function. Whatever is already inside the
+    /// lookahead window is still sent
+    /// \return false if it wasn't scheduled
+    bool cancel(int eventID);
+    void clear();
+    /// \return scheduled events and running functions
+    size_t size() const;
+
+private:
+    struct State;
+    std::shared_ptr<State> state;   ///< shared with the events handed to the scheduler
+};
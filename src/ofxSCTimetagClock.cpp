@@ -0,0 +1,138 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCTimetagClock.h"
+
+#include <cstdlib>
+#include <algorithm>
+
+static const int64_t NANOSECONDS_PER_SECOND = 1000000000LL;
+static const int64_t SECONDS_FROM_1900_TO_1970 = 2208988800LL;
+
+//--------------------------------------------------------------
+ofxSCTimetagClock::ofxSCTimetagClock() : slewNanoseconds(0), resyncInterval(std::chrono::seconds(1)), stepThreshold(std::chrono::milliseconds(10)), lastCorrection(0)
+{
+    anchor = std::chrono::steady_clock::now();
+    anchorNanoseconds = getSystemNanoseconds();
+    nextResync = anchor + resyncInterval;
+}
+
+//--------------------------------------------------------------
+uint64_t ofxSCTimetagClock::getTimetag(double offset)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    if(now >= nextResync) resync(now);
+    return nanosecondsToTimetag(toNanoseconds(now) + (int64_t)(offset * NANOSECONDS_PER_SECOND));
+}
+
+//--------------------------------------------------------------
+uint64_t ofxSCTimetagClock::getTimetag(TimePoint time)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto now = std::chrono::steady_clock::now();
+    if(now >= nextResync) resync(now);
+    return nanosecondsToTimetag(toNanoseconds(time));
+}
+
+//--------------------------------------------------------------
+void ofxSCTimetagClock::resync()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    resync(std::chrono::steady_clock::now());
+}
+
+//--------------------------------------------------------------
+void ofxSCTimetagClock::resync(TimePoint now)
+{
+    // re-anchor where the current mapping is, so the correction starts from zero
+    int64_t predicted = toNanoseconds(now);
+    int64_t error = getSystemNanoseconds() - predicted;
+    anchor = now;
+    lastCorrection = error;
+    if(std::llabs(error) > stepThreshold.count()){
+        anchorNanoseconds = predicted + error;
+        slewNanoseconds = 0;
+    }else{
+        // less than the interval itself, so the mapping never runs backwards
+        anchorNanoseconds = predicted;
+        slewNanoseconds = error;
+    }
+    nextResync = now + resyncInterval;
+}
+
+//--------------------------------------------------------------
+int64_t ofxSCTimetagClock::toNanoseconds(TimePoint time) const
+{
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(time - anchor).count();
+    int64_t slew = 0;
+    if(slewNanoseconds != 0 && elapsed > 0){
+        slew = elapsed >= resyncInterval.count() ? slewNanoseconds : (int64_t)((double)slewNanoseconds * elapsed / resyncInterval.count());
+    }
+    return anchorNanoseconds + elapsed + slew;
+}
+
+//--------------------------------------------------------------
+void ofxSCTimetagClock::setResyncInterval(double seconds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    resyncInterval = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(seconds));
+    // a slew can't be faster than the clock itself
+    if(stepThreshold > resyncInterval / 2) stepThreshold = resyncInterval / 2;
+    nextResync = anchor + resyncInterval;
+}
+
+//--------------------------------------------------------------
+double ofxSCTimetagClock::getResyncInterval() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::chrono::duration<double>(resyncInterval).count();
+}
+
+//--------------------------------------------------------------
+void ofxSCTimetagClock::setStepThreshold(double seconds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stepThreshold = std::min(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(seconds)), resyncInterval / 2);
+}
+
+//--------------------------------------------------------------
+double ofxSCTimetagClock::getStepThreshold() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::chrono::duration<double>(stepThreshold).count();
+}
+
+//--------------------------------------------------------------
+double ofxSCTimetagClock::getLastCorrection() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return (double)lastCorrection / NANOSECONDS_PER_SECOND;
+}
+
+//--------------------------------------------------------------
+uint64_t ofxSCTimetagClock::nanosecondsToTimetag(int64_t nanoseconds)
+{
+    uint64_t seconds = (uint64_t)(nanoseconds / NANOSECONDS_PER_SECOND);
+    uint64_t remainder = (uint64_t)(nanoseconds % NANOSECONDS_PER_SECOND);
+    // remainder < 2^30, so shifting it up 32 bits still fits
+    uint64_t fraction = ((remainder << 32) + NANOSECONDS_PER_SECOND / 2) / NANOSECONDS_PER_SECOND;
+    return (seconds << 32) + fraction;
+}
+
+//--------------------------------------------------------------
+int64_t ofxSCTimetagClock::getSystemNanoseconds()
+{
+    auto sinceEpoch = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch).count() + SECONDS_FROM_1900_TO_1970 * NANOSECONDS_PER_SECOND;
+}
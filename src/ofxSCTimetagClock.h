@@ -0,0 +1,68 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+
+/// OSC timetags (NTP format: seconds since 1900 in the high 32 bits, fraction
+/// in the low 32) with nanosecond resolution.
+///
+/// Time is taken from steady_clock and mapped to wall-clock time through an
+/// anchor, so two events 250 us apart get timetags 250 us apart even if the
+/// system clock is changed in between. The anchor is compared to the system
+/// clock every resync interval, since scsynth schedules against it: small
+/// differences are slewed in over the next interval, keeping timetags
+/// increasing, and differences above the step threshold are jumped.
+class ofxSCTimetagClock
+{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    ofxSCTimetagClock();
+
+    /// \return the timetag for now plus offset seconds
+    uint64_t getTimetag(double offset = 0);
+    /// \return the timetag for a steady_clock time, e.g. a scheduler's due time
+    uint64_t getTimetag(TimePoint time);
+
+    /// compare against the system clock now instead of waiting for the interval
+    void resync();
+
+    void setResyncInterval(double seconds);
+    double getResyncInterval() const;
+    void setStepThreshold(double seconds);
+    double getStepThreshold() const;
+    /// \return the last difference found against the system clock, in seconds
+    double getLastCorrection() const;
+
+    /// \return the timetag for a number of nanoseconds since 1900
+    static uint64_t nanosecondsToTimetag(int64_t nanoseconds);
+    /// \return the system clock in nanoseconds since 1900
+    static int64_t getSystemNanoseconds();
+
+private:
+    int64_t toNanoseconds(TimePoint time) const;
+    void resync(TimePoint now);
+
+    mutable std::mutex mutex;
+    TimePoint anchor;
+    int64_t anchorNanoseconds;      ///< since 1900, at anchor
+    int64_t slewNanoseconds;        ///< correction spread over the resync interval after anchor
+    TimePoint nextResync;
+    std::chrono::nanoseconds resyncInterval;
+    std::chrono::nanoseconds stepThreshold;
+    int64_t lastCorrection;
+};
@@ -0,0 +1,39 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCTransport.h"
+
+#include <vector>
+
+// Encoding scratch space, one per thread so any thread can send. It only ever
+// grows, so after the first few sends encoding doesn't allocate.
+static std::vector<char> &getScratchBuffer(){
+    thread_local std::vector<char> buffer;
+    return buffer;
+}
+
+//--------------------------------------------------------------
+char *ofxSCTransport::reserve(size_t size)
+{
+    std::vector<char> &buffer = getScratchBuffer();
+    if(buffer.size() < size){
+        buffer.resize(size);
+    }
+    return buffer.data();
+}
+
+//--------------------------------------------------------------
+void ofxSCTransport::commit(size_t size)
+{
+    send(getScratchBuffer().data(), size);
+}
@@ -0,0 +1,81 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+#include "IpEndpointName.h"
+
+/// transmit counters, to see how much batching saves
+struct ofxSCTransmitStats {
+    uint64_t sendCalls = 0;     ///< send/sendmmsg system calls, or send function calls
+    uint64_t datagrams = 0;     ///< packets, framed ones for TCP
+    uint64_t bytes = 0;
+};
+
+/// receive counters, same idea
+struct ofxSCReceiveStats {
+    uint64_t receiveCalls = 0;  ///< recv/recvfrom/recvmmsg system calls that returned data
+    uint64_t datagrams = 0;     ///< packets, framed ones for TCP
+    uint64_t bytes = 0;
+};
+
+/// Moves encoded OSC packets between the client and a server: ofxSCUdpSocket,
+/// ofxSCTcpSocket, or ofxSCLoopbackTransport for a server in the same process.
+/// ofxOscSenderReceiver encodes into reserve() and hands the packet over with
+/// commit(), received packets go to the callback given to startReceiving().
+class ofxSCTransport
+{
+public:
+    typedef std::function<void(const char *data, size_t size, const osc::IpEndpointName &from)> PacketCallback;
+
+    virtual ~ofxSCTransport() {}
+
+    virtual void close() = 0;
+    virtual bool isOpen() const = 0;
+
+    /// send one packet, or queue it while a batch is open
+    virtual void send(const char *data, size_t size) = 0;
+
+    /// \return room to encode a packet of up to size bytes, pass it on with commit()
+    /// or cancel() on the same thread. By default a scratch buffer per thread that
+    /// commit() sends from
+    virtual char *reserve(size_t size);
+    /// send the packet encoded in the last reserve(), size bytes long
+    virtual void commit(size_t size);
+    /// drop the packet of the last reserve() unsent
+    virtual void cancel() {}
+
+    /// batches nest, packets go out when the outermost one ends
+    virtual void beginBatch() {}
+    virtual void endBatch() {}
+    /// send whatever is queued
+    virtual void flush() {}
+
+    /// call callback for every packet that arrives
+    /// \return false if receiving couldn't be set up
+    virtual bool startReceiving(PacketCallback callback) = 0;
+    virtual void stopReceiving() = 0;
+    virtual bool isReceiving() const = 0;
+
+    /// \return true if packets have to fit in a datagram, false if any size goes
+    virtual bool isPacketSizeLimited() const {return true;};
+    /// \return true if any thread may send at any time
+    virtual bool isThreadSafe() const {return false;};
+
+    virtual ofxSCTransmitStats getStats() const {return ofxSCTransmitStats();};
+    virtual ofxSCReceiveStats getReceiveStats() const {return ofxSCReceiveStats();};
+};
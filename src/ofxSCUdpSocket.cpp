@@ -0,0 +1,255 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCUdpSocket.h"
+
+#ifdef OFXSC_HAS_NATIVE_SOCKETS
+
+#include <cstring>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <unistd.h>
+
+#include "ofLog.h"
+
+// datagrams queued before a batch is flushed early, sendmmsg takes at most UIO_MAXIOV (1024)
+static const size_t MAX_BATCH = 256;
+// replies come in bursts, give the kernel room to hold them while we catch up
+static const int RECEIVE_BUFFER_SIZE = 1 << 20;
+static const size_t MAX_DATAGRAM_SIZE = 65536;
+// datagrams read per recvmmsg call
+#if defined(__linux__)
+static const size_t RECEIVE_BATCH = 32;
+#else
+static const size_t RECEIVE_BATCH = 1;
+#endif
+
+//--------------------------------------------------------------
+ofxSCUdpSocket::ofxSCUdpSocket()
+{
+}
+
+//--------------------------------------------------------------
+ofxSCUdpSocket::~ofxSCUdpSocket()
+{
+    close();
+}
+
+//--------------------------------------------------------------
+bool ofxSCUdpSocket::open(const std::string &host, int outPort, int inPort, bool reuse)
+{
+    close();
+
+    addrinfo *destination = nullptr;
+    if(!host.empty()){
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        if(getaddrinfo(host.c_str(), std::to_string(outPort).c_str(), &hints, &destination) != 0 || destination == nullptr){
+            ofLogError("ofxSCUdpSocket") << "bad host? " << host;
+            return false;
+        }
+    }
+
+    fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if(fd < 0){
+        ofLogError("ofxSCUdpSocket") << "couldn't create socket: " << std::strerror(errno);
+        if(destination) freeaddrinfo(destination);
+        return false;
+    }
+
+    int on = 1;
+    if(reuse){
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#ifdef SO_REUSEPORT
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+#endif
+    }
+    int receiveBufferSize = RECEIVE_BUFFER_SIZE;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize));
+
+    sockaddr_in local;
+    std::memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(inPort);
+    if(::bind(fd, (sockaddr*)&local, sizeof(local)) < 0){
+        ofLogError("ofxSCUdpSocket") << "couldn't bind to port " << inPort << ": " << std::strerror(errno);
+        if(destination) freeaddrinfo(destination);
+        close();
+        return false;
+    }
+
+    if(destination){
+        int connected = ::connect(fd, destination->ai_addr, destination->ai_addrlen);
+        freeaddrinfo(destination);
+        if(connected < 0){
+            ofLogError("ofxSCUdpSocket") << "couldn't connect to " << host << " on port " << outPort << ": " << std::strerror(errno);
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------
+void ofxSCUdpSocket::sendTo(const char *data, size_t size, const osc::IpEndpointName &to)
+{
+    std::lock_guard<std::recursive_mutex> lock(sendMutex);
+    if(fd < 0) return;
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl((uint32_t)to.address);
+    address.sin_port = htons(to.port);
+    ::sendto(fd, data, size, 0, (sockaddr*)&address, sizeof(address));
+    stats.sendCalls++;
+    stats.datagrams++;
+    stats.bytes += size;
+}
+
+//--------------------------------------------------------------
+void ofxSCUdpSocket::send(const char *data, size_t size)
+{
+    std::lock_guard<std::recursive_mutex> lock(sendMutex);
+    if(fd < 0) return;
+
+    if(batchDepth == 0){
+        ::send(fd, data, size, 0);
+        stats.sendCalls++;
+        stats.datagrams++;
+        stats.bytes += size;
+        return;
+    }
+
+    queueOffsets.push_back(queueData.size());
+    queueData.insert(queueData.end(), data, data + size);
+    if(queueOffsets.size() == MAX_BATCH){
+        flush();
+    }
+}
+
+//--------------------------------------------------------------
+void ofxSCUdpSocket::flush()
+{
+    std::lock_guard<std::recursive_mutex> lock(sendMutex);
+    size_t count = queueOffsets.size();
+    if(count == 0 || fd < 0) return;
+
+    auto datagramSize = [&](size_t i){
+        size_t end = i + 1 < count ? queueOffsets[i + 1] : queueData.size();
+        return end - queueOffsets[i];
+    };
+
+#if defined(__linux__)
+    mmsghdr messages[MAX_BATCH];
+    iovec iovecs[MAX_BATCH];
+    std::memset(messages, 0, sizeof(mmsghdr) * count);
+    for(size_t i = 0; i < count; i++){
+        iovecs[i].iov_base = queueData.data() + queueOffsets[i];
+        iovecs[i].iov_len = datagramSize(i);
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    size_t sent = 0;
+    int failures = 0;
+    while(sent < count){
+        int n = sendmmsg(fd, messages + sent, count - sent, 0);
+        stats.sendCalls++;
+        if(n < 0){
+            // a refused earlier datagram is reported on the next call, that one is worth a retry
+            if((errno == EINTR || errno == ECONNREFUSED) && ++failures < 3) continue;
+            ofLogWarning("ofxSCUdpSocket") << "sendmmsg failed, dropping " << count - sent << " datagrams: " << std::strerror(errno);
+            break;
+        }
+        for(int i = 0; i < n; i++) stats.bytes += iovecs[sent + i].iov_len;
+        stats.datagrams += n;
+        sent += n;
+    }
+#else
+    for(size_t i = 0; i < count; i++){
+        ::send(fd, queueData.data() + queueOffsets[i], datagramSize(i), 0);
+        stats.sendCalls++;
+        stats.datagrams++;
+        stats.bytes += datagramSize(i);
+    }
+#endif
+
+    queueData.clear();
+    queueOffsets.clear();
+}
+
+//--------------------------------------------------------------
+bool ofxSCUdpSocket::drainSocket()
+{
+    if(receiveData.empty()) receiveData.resize(RECEIVE_BATCH * MAX_DATAGRAM_SIZE);
+
+#if defined(__linux__)
+    mmsghdr messages[RECEIVE_BATCH];
+    iovec iovecs[RECEIVE_BATCH];
+    sockaddr_in from[RECEIVE_BATCH];
+
+    while(receiving){
+        std::memset(messages, 0, sizeof(messages));
+        for(size_t i = 0; i < RECEIVE_BATCH; i++){
+            iovecs[i].iov_base = receiveData.data() + i * MAX_DATAGRAM_SIZE;
+            iovecs[i].iov_len = MAX_DATAGRAM_SIZE;
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_name = &from[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+
+        // a pending error from an earlier send (refused port) also ends up here, epoll brings us back if data is left
+        int n = recvmmsg(fd, messages, RECEIVE_BATCH, MSG_DONTWAIT, nullptr);
+        if(n <= 0) return true;
+
+        size_t bytes = 0;
+        for(int i = 0; i < n; i++){
+            size_t size = messages[i].msg_len;
+            bytes += size;
+            if(messages[i].msg_hdr.msg_flags & MSG_TRUNC){
+                ofLogWarning("ofxSCUdpSocket") << "dropping truncated datagram";
+                continue;
+            }
+            osc::IpEndpointName endpoint(ntohl(from[i].sin_addr.s_addr), ntohs(from[i].sin_port));
+            callback((const char*)iovecs[i].iov_base, size, endpoint);
+        }
+        countReceived(n, bytes);
+
+        // a short read means the socket is empty
+        if(n < (int)RECEIVE_BATCH) return true;
+    }
+#else
+    while(receiving){
+        sockaddr_in from;
+        socklen_t fromLength = sizeof(from);
+        ssize_t size = recvfrom(fd, receiveData.data(), MAX_DATAGRAM_SIZE, MSG_DONTWAIT, (sockaddr*)&from, &fromLength);
+        if(size <= 0) return true;
+        countReceived(1, size);
+
+        osc::IpEndpointName endpoint(ntohl(from.sin_addr.s_addr), ntohs(from.sin_port));
+        callback(receiveData.data(), size, endpoint);
+    }
+#endif
+    return true;
+}
+
+#endif
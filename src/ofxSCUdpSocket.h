@@ -0,0 +1,54 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "ofxSCSocket.h"
+
+#ifdef OFXSC_HAS_NATIVE_SOCKETS
+
+#include <vector>
+
+/// UDP socket on plain POSIX calls, bound to the receive port and connected to
+/// the server, so replies come back to the same port the requests leave from.
+/// Datagrams sent between beginBatch() and endBatch() are queued and go out
+/// together with sendmmsg on Linux, one send per datagram elsewhere. Received
+/// datagrams are drained with recvmmsg, many per call.
+class ofxSCUdpSocket : public ofxSCSocket
+{
+public:
+    ofxSCUdpSocket();
+    ~ofxSCUdpSocket();
+
+    /// with an empty host the socket is only bound, send with sendTo() then
+    /// \return true on success, errors are logged
+    bool open(const std::string &host, int outPort, int inPort, bool reuse);
+
+    void send(const char *data, size_t size) override;
+    /// send one datagram to a given endpoint right away, batches don't apply
+    void sendTo(const char *data, size_t size, const osc::IpEndpointName &to);
+    void flush() override;
+
+protected:
+    bool drainSocket() override;
+
+private:
+    // queued datagrams, packed one after the other in queueData
+    std::vector<char> queueData;
+    std::vector<size_t> queueOffsets;
+
+    // receive buffers, allocated by the receive thread on first use
+    std::vector<char> receiveData;
+};
+
+#endif
@@ -0,0 +1,174 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCWakeup.h"
+
+#include <algorithm>
+
+#if !defined(_WIN32)
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#endif
+
+#include "ofLog.h"
+
+#if defined(_WIN32)
+
+//--------------------------------------------------------------
+ofxSCWakeup::ofxSCWakeup() : waiting(false), woken(false)
+{
+}
+
+//--------------------------------------------------------------
+ofxSCWakeup::~ofxSCWakeup()
+{
+}
+
+//--------------------------------------------------------------
+bool ofxSCWakeup::open()
+{
+    return true;
+}
+
+//--------------------------------------------------------------
+bool ofxSCWakeup::isOpen() const
+{
+    return true;
+}
+
+//--------------------------------------------------------------
+void ofxSCWakeup::wait(TimePoint until)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if(until == TimePoint::max()){
+        condition.wait(lock, [this]{ return woken; });
+    }else{
+        condition.wait_until(lock, until, [this]{ return woken; });
+    }
+    woken = false;
+    waiting.store(false);
+}
+
+//--------------------------------------------------------------
+void ofxSCWakeup::wake()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(!waiting.exchange(false)) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    woken = true;
+    condition.notify_one();
+}
+
+#else
+
+//--------------------------------------------------------------
+ofxSCWakeup::ofxSCWakeup() : waiting(false), readFd(-1), writeFd(-1)
+{
+}
+
+//--------------------------------------------------------------
+ofxSCWakeup::~ofxSCWakeup()
+{
+    if(readFd >= 0) ::close(readFd);
+    if(writeFd >= 0 && writeFd != readFd) ::close(writeFd);
+}
+
+//--------------------------------------------------------------
+bool ofxSCWakeup::open()
+{
+    if(readFd >= 0) return true;
+#if defined(__linux__)
+    readFd = writeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(readFd < 0){
+        ofLogError("ofxSCWakeup") << "couldn't create eventfd: " << std::strerror(errno);
+        return false;
+    }
+#else
+    int pipeFds[2];
+    if(pipe(pipeFds) < 0){
+        ofLogError("ofxSCWakeup") << "couldn't create wakeup pipe: " << std::strerror(errno);
+        return false;
+    }
+    for(int pipeFd : pipeFds){
+        fcntl(pipeFd, F_SETFL, fcntl(pipeFd, F_GETFL) | O_NONBLOCK);
+        fcntl(pipeFd, F_SETFD, FD_CLOEXEC);
+    }
+    readFd = pipeFds[0];
+    writeFd = pipeFds[1];
+#endif
+    return true;
+}
+
+//--------------------------------------------------------------
+bool ofxSCWakeup::isOpen() const
+{
+    return readFd >= 0;
+}
+
+//--------------------------------------------------------------
+void ofxSCWakeup::wait(TimePoint until)
+{
+    pollfd pfd;
+    pfd.fd = readFd;
+    pfd.events = POLLIN;
+    int timeout = -1;
+    if(until != TimePoint::max()){
+        // rounded up, so it doesn't wake just before until and spin
+        auto left = until - std::chrono::steady_clock::now();
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(left + std::chrono::microseconds(999)).count();
+        timeout = ms <= 0 ? 0 : (int)std::min<decltype(ms)>(ms, INT_MAX);
+    }
+    if(timeout != 0 && poll(&pfd, 1, timeout) > 0){
+        // whatever was written, a wake counts once
+        char drain[64];
+        while(::read(readFd, drain, sizeof(drain)) > 0){}
+    }
+    waiting.store(false);
+}
+
+//--------------------------------------------------------------
+void ofxSCWakeup::wake()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(!waiting.exchange(false)) return;
+    uint64_t one = 1;
+    // EAGAIN: a wake is pending already
+    if(::write(writeFd, &one, sizeof(one)) < 0 && errno != EAGAIN){
+        ofLogError("ofxSCWakeup") << "couldn't wake: " << std::strerror(errno);
+    }
+}
+
+#endif
+
+//--------------------------------------------------------------
+void ofxSCWakeup::prepare()
+{
+    waiting.store(true);
+    // pairs with the exchange in wake(): either the sleeper sees the work that
+    // came before, or the waker sees the sleeper
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+//--------------------------------------------------------------
+void ofxSCWakeup::cancel()
+{
+    waiting.store(false);
+}
@@ -0,0 +1,62 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#if defined(_WIN32)
+#include <mutex>
+#include <condition_variable>
+#endif
+
+/// Lets one thread sleep until another has work for it. The sleeper calls
+/// prepare(), checks for work, then wait() (or cancel() if it found some);
+/// wake() from any thread in between ends the wait, and wakes from before
+/// prepare() are left to that check. An eventfd on Linux, a pipe on other
+/// POSIX systems: wake() is an atomic exchange and, only while someone
+/// sleeps, one non-blocking write, so it can be called from an audio
+/// callback. On Windows a condition variable, whose wake() takes a lock.
+class ofxSCWakeup
+{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    ofxSCWakeup();
+    ~ofxSCWakeup();
+
+    /// \return false if the descriptors couldn't be created
+    bool open();
+    bool isOpen() const;
+
+    /// from here on wake() ends the next wait()
+    void prepare();
+    void cancel();
+    /// sleep until woken or until, TimePoint::max() for no timeout
+    void wait(TimePoint until);
+    /// end the wait of the sleeper, if there is one
+    void wake();
+
+private:
+    std::atomic<bool> waiting;
+#if defined(_WIN32)
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool woken;
+#else
+    // both ends are the same eventfd on Linux
+    int readFd;
+    int writeFd;
+#endif
+};
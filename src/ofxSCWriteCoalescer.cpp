@@ -0,0 +1,92 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "ofxSCWriteCoalescer.h"
+
+void ofxSCWriteCoalescer::setControl(int nodeID, const std::string &control, float value)
+{
+    setControl(nodeID, control, Value{false, 0, value});
+}
+
+void ofxSCWriteCoalescer::setControl(int nodeID, const std::string &control, int value)
+{
+    setControl(nodeID, control, Value{true, value, 0});
+}
+
+void ofxSCWriteCoalescer::setControl(int nodeID, const std::string &control, const Value &value)
+{
+    stats.writes++;
+    
+    auto slot = nodeSlots.find(nodeID);
+    if(slot == nodeSlots.end()){
+        slot = nodeSlots.emplace(nodeID, nodes.size()).first;
+        nodes.push_back({nodeID, {}});
+    }
+    
+    // synths have a handful of controls, a linear search beats hashing the name
+    auto &controls = nodes[slot->second].controls;
+    for(auto &c : controls){
+        if(c.name == control){
+            c.value = value;
+            stats.collapsed++;
+            return;
+        }
+    }
+    controls.push_back({control, value});
+}
+
+void ofxSCWriteCoalescer::setBus(int index, float value)
+{
+    stats.writes++;
+    
+    auto slot = busSlots.find(index);
+    if(slot != busSlots.end()){
+        busses[slot->second].value = value;
+        stats.collapsed++;
+        return;
+    }
+    busSlots.emplace(index, busses.size());
+    busses.push_back({index, value});
+}
+
+void ofxSCWriteCoalescer::flush(ofxOscBundle &bundle)
+{
+    for(auto &node : nodes){
+        ofxOscMessage m;
+        m.setAddress("/n_set");
+        m.addIntArg(node.nodeID);
+        for(auto &c : node.controls){
+            m.addStringArg(c.name);
+            if(c.value.isInt) m.addIntArg(c.value.intValue);
+            else m.addFloatArg(c.value.floatValue);
+        }
+        bundle.addMessage(m);
+        stats.messages++;
+    }
+    
+    if(!busses.empty()){
+        ofxOscMessage m;
+        m.setAddress("/c_set");
+        for(auto &b : busses){
+            m.addIntArg(b.index);
+            m.addFloatArg(b.value);
+        }
+        bundle.addMessage(m);
+        stats.messages++;
+    }
+    
+    nodes.clear();
+    nodeSlots.clear();
+    busses.clear();
+    busSlots.clear();
+}
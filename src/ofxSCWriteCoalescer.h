@@ -0,0 +1,73 @@
+/*-----------------------------------------------------------------------------
+ *
+ * ofxSuperCollider: a SuperCollider control addon for openFrameworks.
+ *
+ * Copyright (c) 2009 Daniel Jones.
+ *
+ *	 <http://www.erase.net/>
+ *
+ * Distributed under the MIT License.
+ * For more information, see ofxSuperCollider.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include "ofxOsc.h"
+
+struct ofxSCCoalescingStats {
+    uint64_t writes = 0;        ///< control and bus writes received
+    uint64_t collapsed = 0;     ///< writes overwritten by a later one to the same control or bus before a flush
+    uint64_t messages = 0;      ///< messages emitted by flush
+};
+
+/// Last-value-wins buffer for /n_set and /c_set. Writes are keyed by
+/// (nodeID, control) and bus index, only the latest value of each survives,
+/// and flush emits one /n_set per node and one /c_set for all busses.
+class ofxSCWriteCoalescer
+{
+public:
+    void setControl(int nodeID, const std::string &control, float value);
+    void setControl(int nodeID, const std::string &control, int value);
+    void setBus(int index, float value);
+    
+    bool empty() const {return nodes.empty() && busses.empty();};
+    
+    /// add the pending writes to bundle, in the order nodes and busses were first written
+    void flush(ofxOscBundle &bundle);
+    
+    const ofxSCCoalescingStats &getStats() const {return stats;};
+    void resetStats() {stats = ofxSCCoalescingStats();};
+    
+private:
+    struct Value{
+        bool isInt;
+        int intValue;
+        float floatValue;
+    };
+    struct Control{
+        std::string name;
+        Value value;
+    };
+    struct NodeWrites{
+        int nodeID;
+        std::vector<Control> controls;
+    };
+    struct BusWrite{
+        int index;
+        float value;
+    };
+    
+    void setControl(int nodeID, const std::string &control, const Value &value);
+    
+    std::vector<NodeWrites> nodes;
+    std::unordered_map<int, size_t> nodeSlots;  ///< nodeID -> position in nodes
+    std::vector<BusWrite> busses;
+    std::unordered_map<int, size_t> busSlots;   ///< bus index -> position in busses
+    
+    ofxSCCoalescingStats stats;
+};
@@ -44,3 +44,6 @@ enum rates
 #include "ofxSCGroup.h"
 #include "ofxSCBus.h"
 #include "ofxSCBuffer.h"
+#include "ofxSCLoopbackTransport.h"
+#include "ofxSCMockServer.h"
+#include "ofxSCTempoClock.h"